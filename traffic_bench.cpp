@@ -0,0 +1,314 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <new>
+#include <random>
+#include <vector>
+#include "traffic_core.h"
+
+// Benchmark suite for the per-tick routines of World on synthetic fleets. Each fleet
+// is a standing queue on the four approaches, front to back, so every routine runs on
+// the same deterministic state. Results are CSV on stdout, one row per routine and
+// fleet size; a pass is what one tick does: one call for spawnCars, cullCars,
+// light.update and the full tick, every car for the per-car routines.
+
+// Heap allocations made by this process, counted to report allocations per pass.
+static size_t allocations = 0;
+void* operator new(size_t n){
+    allocations++;
+    if(void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+static volatile size_t sink = 0;
+static const float kDt = 1.0f / 60.0f;
+
+// n cars split over the four spawn lanes, evenly spaced from the exit edge back. With
+// spawnRoom the E and W lanes stop short of their spawn point, so both spawn; the N/S
+// clearance window covers the whole lane, so those only spawn into an empty lane.
+// outOfBounds moves that share of each lane's front cars just past the exit edge.
+static void buildFleet(World& w, size_t n, bool spawnRoom = false, float outOfBounds = 0){
+    w.cars.reserve(n);
+    const size_t perLane = (n + 3) / 4;
+    const float room = spawnRoom ? 7.0f : 0.0f;
+    const float span[4] = { 26.4f, 26.4f, 42.4f - room, 42.4f - room };
+    for(size_t k = 0; k < n; k++){
+        int a = int(k % 4);
+        float d = std::min(2.8f, span[a] / float(perLane)) * float(k / 4);
+        Car c; c.active = true;
+        if(a == 0){ c.axis='N'; c.lane=0; c.x=-1.0f; c.y=13.9f - d; c.vx=0; c.vy=1; }
+        if(a == 1){ c.axis='S'; c.lane=1; c.x=1.0f; c.y=-13.9f + d; c.vx=0; c.vy=-1; }
+        if(a == 2){ c.axis='E'; c.lane=0; c.y=-1.0f; c.x=21.9f - d; c.vx=1; c.vy=0; }
+        if(a == 3){ c.axis='W'; c.lane=1; c.y=1.0f; c.x=-21.9f + d; c.vx=-1; c.vy=0; }
+        w.addCar(c);
+    }
+    for(int L = 0; L < LaneIndex::kLanes; L++){
+        const std::vector<uint32_t>& lane = w.lanes.lanes[L];
+        const size_t out = std::min(lane.size(), size_t(std::ceil(outOfBounds * float(lane.size()))));
+        for(size_t k = 0; k < out; k++){
+            uint32_t i = lane[k];
+            float past = 0.5f + float(out - 1 - k);
+            char axis = char(w.cars.axis[i]);
+            if(axis == 'N') w.cars.y[i] = 14.0f + past;
+            if(axis == 'S') w.cars.y[i] = -14.0f - past;
+            if(axis == 'E') w.cars.x[i] = 22.0f + past;
+            if(axis == 'W') w.cars.x[i] = -22.0f - past;
+        }
+    }
+    w.computeStopMask(kDt);
+}
+
+// Puts w back to the state of base, which must hold the same fleet parameters; World
+// itself is not assignable. Reuses w's buffers, so a restore allocates nothing.
+static void restore(World& w, const World& base){
+    w.cars = base.cars;
+    w.lanes = base.lanes;
+    w.light = base.light;
+    w.spawnTimerNS = base.spawnTimerNS; w.spawnTimerEW = base.spawnTimerEW;
+    w.spawnIntervalNS = base.spawnIntervalNS; w.spawnIntervalEW = base.spawnIntervalEW;
+    w.exits.clear();
+}
+
+struct Sample { size_t passes; double seconds; size_t allocs; };
+
+// Repeats pass until minSeconds have elapsed (at least 3 times) after one warm-up.
+template<class F>
+static Sample measure(double minSeconds, F&& pass){
+    pass();
+    Sample s{0, 0.0, allocations};
+    auto start = std::chrono::steady_clock::now();
+    do {
+        pass();
+        s.passes++;
+        s.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while(s.passes < 3 || s.seconds < minSeconds);
+    s.allocs = allocations - s.allocs;
+    return s;
+}
+
+// As measure, for passes that change what they run on: reset() restores the input
+// before every pass and is not timed, so every pass sees the same fleet.
+template<class R, class F>
+static Sample measureFrom(double minSeconds, R&& reset, F&& pass){
+    reset(); pass();
+    Sample s{0, 0.0, 0};
+    do {
+        reset();
+        size_t allocs = allocations;
+        auto start = std::chrono::steady_clock::now();
+        pass();
+        s.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        s.allocs += allocations - allocs;
+        s.passes++;
+    } while(s.passes < 3 || s.seconds < minSeconds);
+    return s;
+}
+
+static void report(const char* routine, size_t cars, const Sample& s){
+    double ns = s.seconds * 1e9 / double(s.passes);
+    printf("%s,%zu,%.1f,%.4f,%.1f,%.3f\n", routine, cars, ns, ns / double(cars),
+           s.seconds > 0 ? double(s.passes) / s.seconds : 0.0, double(s.allocs) / double(s.passes));
+}
+
+// The batched signal kernel against the per-car rule, on every lane and light state,
+// for the fleet plus cars placed exactly on each rule's threshold.
+static size_t signalMismatches(World& w){
+    size_t bad = 0;
+    std::vector<float> x, y;
+    std::vector<uint8_t> hold;
+    const float edges[] = { World::kPastLine, World::kGoOnYellow, World::kStopGap };
+    for(int st = 0; st < 3; st++){
+        w.light.north.state = w.light.south.state = w.light.east.state = w.light.west.state = LightState(st);
+        for(int L = 0; L < LaneIndex::kLanes; L++){
+            const char axis = "NSEW"[L / 2];
+            const std::vector<uint32_t>& lane = w.lanes.lanes[L];
+            x.clear(); y.clear();
+            for(uint32_t i : lane){ x.push_back(w.cars.x[i]); y.push_back(w.cars.y[i]); }
+            const bool ns = axis=='N' || axis=='S';
+            const float sign = (axis=='N' || axis=='E') ? -1.0f : 1.0f;
+            for(float e : edges){
+                float along = sign * (e + (ns ? w.stopNS : w.stopEW));
+                x.push_back(ns ? -1.0f : along); y.push_back(ns ? along : -1.0f);
+            }
+            hold.resize(x.size());
+            w.signalStopMask(x.data(), y.data(), x.size(), axis, hold.data());
+            for(size_t k = 0; k < x.size(); k++) bad += hold[k] != w.shouldStopAtSignal(x[k], y[k], axis);
+        }
+    }
+    return bad;
+}
+
+// Straightforward polling model of TrafficLightSystem: every timer is an elapsed count
+// in microseconds, advanced and checked once at the end of each tick. It follows the
+// controller's rules (plan steps with demand extension under automatic control, head
+// timeouts under emergency control, the 30 s emergency timeout) without any scheduling.
+struct PollingLights {
+    const SignalPlan* plan = nullptr;
+    LightState head[4] = {};
+    uint64_t headUs[4] = {}, stepUs = 0, targetUs = 0, emergencyUs = 0;
+    uint16_t step = 0;
+    bool manual = false, emergency = false;
+
+    static uint64_t micros(float s){ return uint64_t(std::llround(double(s) * 1e6)); }
+    bool headsRun() const { return emergency && !manual; }
+    bool stepRuns() const { return !manual && !emergency && plan->count; }
+
+    void set(int i, LightState s){ head[i] = s; headUs[i] = 0; }
+    void applyStep(){ for(int i = 0; i < 4; i++) set(i, LightState(plan->steps[step].heads >> (2*i) & 3)); }
+    // A mode change restarts the wait for the current step at its minimum.
+    void refresh(){ targetUs = plan->steps[step].minUs; }
+
+    void setPlan(const SignalPlan& p){ plan = &p; step = 0; applyStep(); stepUs = 0; refresh(); }
+    void setManual(bool on){ manual = on; refresh(); }
+    void setEmergency(bool on){ emergency = on; emergencyUs = 0; refresh(); }
+
+    void update(uint64_t dt, uint8_t demand, const IndividualLight (&lights)[4]){
+        if(emergency && emergencyUs + dt >= 30000000){
+            // The timeout clears as of the start of the tick, which all goes to the plan.
+            emergency = false;
+            refresh();
+            if(stepRuns()) stepUs += dt;
+        } else {
+            if(emergency) emergencyUs += dt;
+            if(stepRuns()) stepUs += dt;
+            if(headsRun()) for(int i = 0; i < 4; i++) headUs[i] += dt;
+        }
+        if(headsRun()){
+            for(int i = 0; i < 4; i++){
+                if(head[i] == LightState::GREEN && headUs[i] >= micros(lights[i].greenTime)) set(i, LightState::YELLOW);
+                else if(head[i] == LightState::YELLOW && headUs[i] >= micros(lights[i].yellowTime)) set(i, LightState::RED);
+            }
+        }
+        if(stepRuns() && stepUs >= targetUs){
+            const SignalStep& cur = plan->steps[step];
+            if((demand & cur.movements) && stepUs < cur.maxUs){
+                targetUs = std::min<uint64_t>(stepUs + plan->passageUs, cur.maxUs);
+            } else {
+                step = cur.next;
+                applyStep();
+                stepUs = 0;
+                targetUs = plan->steps[step].minUs;
+            }
+        }
+    }
+};
+
+// The event-driven controller against the polling model over random runs: random tick
+// lengths, demand, plans and operator input (manual, emergency, setting heads).
+// Returns the number of ticks on which the two disagree.
+static size_t controllerMismatches(){
+    std::mt19937 rng(12345);
+    SignalPlan zeroGreens;
+    compileSignalProgram(std::vector<SignalPhase>{ {MOVE_E | MOVE_W, 0, 0, 0, 0}, {MOVE_N | MOVE_S, 0, 0.5f, 0.2f, 0} }, zeroGreens);
+    const SignalPlan* plans[] = { &kTwoPhasePlan, &kFourPhasePlan, &kActuatedTwoPhasePlan, &zeroGreens };
+    const float steps[] = { 0.001f, 1.0f / 60.0f, 0.1f, 0.75f };
+    size_t bad = 0;
+    for(int run = 0; run < 64; run++){
+        TrafficLightSystem sys;
+        PollingLights ref;
+        const SignalPlan& plan = *plans[run % 4];
+        sys.setPlan(plan);
+        ref.setPlan(plan);
+        const float dt = steps[(run / 4) % 4];
+        for(int t = 0; t < 20000; t++){
+            uint32_t r = rng();
+            if(r % 400 == 0){ bool on = rng() & 1; sys.setManual(on); ref.setManual(on); }
+            if(r % 400 == 1){ bool on = rng() % 3 != 0; sys.setEmergencyMode(on); ref.setEmergency(on); }
+            if(r % 50 == 2){
+                int i = int(rng() % 4);
+                LightState s = LightState(rng() % 3);
+                IndividualLight* heads[4] = { &sys.north, &sys.south, &sys.east, &sys.west };
+                heads[i]->setState(s);
+                ref.set(i, s);
+            }
+            sys.demand = uint8_t(rng() % 16);
+            sys.update(dt);
+            const IndividualLight lights[4] = { sys.north, sys.south, sys.east, sys.west };
+            ref.update(uint64_t(std::llround(double(dt) * 1e6)), sys.demand, lights);
+            bool same = sys.step == ref.step && sys.emergencyMode == ref.emergency;
+            for(int i = 0; i < 4; i++) same = same && lights[i].state == ref.head[i];
+            bad += !same;
+        }
+    }
+    return bad;
+}
+
+static void usage(const char* exe){
+    printf("Usage: %s [--min-cars N] [--max-cars N] [--min-time S]\n", exe);
+    printf("  --min-cars N     smallest fleet (default 100)\n");
+    printf("  --max-cars N     largest fleet; sizes grow tenfold (default 1000000)\n");
+    printf("  --min-time S     seconds to spend on each row at least (default 0.2)\n");
+}
+
+int main(int argc, char** argv){
+    size_t minCars = 100, maxCars = 1000000;
+    double minTime = 0.2;
+    for(int i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "--min-cars") && i+1 < argc) minCars = size_t(atol(argv[++i]));
+        else if(!strcmp(argv[i], "--max-cars") && i+1 < argc) maxCars = size_t(atol(argv[++i]));
+        else if(!strcmp(argv[i], "--min-time") && i+1 < argc) minTime = atof(argv[++i]);
+        else { usage(argv[0]); return strcmp(argv[i], "--help") ? 1 : 0; }
+    }
+    if(minCars < 4 || maxCars < minCars || minTime < 0){ usage(argv[0]); return 1; }
+
+    size_t mismatches = 0;
+    printf("routine,cars,ns_per_pass,ns_per_car,passes_per_sec,allocs_per_pass\n");
+    for(size_t n = minCars; n <= maxCars; n *= 10){
+        {
+            World w; buildFleet(w, n);
+            report("hasFrontCarTooClose", n, measure(minTime, [&]{
+                size_t held = 0;
+                for(int L = 0; L < LaneIndex::kLanes; L++)
+                    for(size_t k = 0; k < w.lanes.lanes[L].size(); k++) held += w.hasFrontCarTooClose(L, k, kDt);
+                sink = held;
+            }));
+            report("shouldStopAtSignal", n, measure(minTime, [&]{
+                size_t held = 0;
+                for(size_t i = 0; i < w.cars.size(); i++) held += w.shouldStopAtSignal(w.cars.x[i], w.cars.y[i], char(w.cars.axis[i]));
+                sink = held;
+            }));
+            // Lane positions gathered once, so the row times the kernel and not the gather.
+            std::vector<float> lx[LaneIndex::kLanes], ly[LaneIndex::kLanes];
+            std::vector<uint8_t> hold(n);
+            for(int L = 0; L < LaneIndex::kLanes; L++)
+                for(uint32_t i : w.lanes.lanes[L]){ lx[L].push_back(w.cars.x[i]); ly[L].push_back(w.cars.y[i]); }
+            report("signalStopMask", n, measure(minTime, [&]{
+                for(int L = 0; L < LaneIndex::kLanes; L++)
+                    w.signalStopMask(lx[L].data(), ly[L].data(), lx[L].size(), "NSEW"[L / 2], hold.data());
+                sink = hold[0];
+            }));
+            report("computeStopMask", n, measure(minTime, [&]{ w.computeStopMask(kDt); }));
+            mismatches += signalMismatches(w);
+        }
+        // The rows below change the fleet, so each pass starts from a restored copy of
+        // base and runs on the labelled number of cars.
+        {
+            // Both timers due and the E/W lanes clear, so two cars spawn every pass.
+            World base, w;
+            buildFleet(base, n, true);
+            base.spawnTimerNS = base.spawnIntervalNS; base.spawnTimerEW = base.spawnIntervalEW;
+            report("spawnCars", n, measureFrom(minTime, [&]{ restore(w, base); }, [&]{ w.spawnCars(kDt); }));
+            report("light.update", n, measure(minTime, [&]{ w.light.update(kDt); }));
+        }
+        {
+            // A tenth of every lane is past the exit edge and is retired every pass.
+            World base, w;
+            buildFleet(base, n, false, 0.1f);
+            report("cullCars", n, measureFrom(minTime, [&]{ restore(w, base); }, [&]{ w.cullCars(); }));
+        }
+        {
+            World base, w;
+            buildFleet(base, n);
+            report("World::update", n, measureFrom(minTime, [&]{ restore(w, base); }, [&]{ w.update(kDt); }));
+        }
+        if(n > maxCars / 10) break;
+    }
+    if(mismatches) fprintf(stderr, "signalStopMask differs from shouldStopAtSignal for %zu cars\n", mismatches);
+    size_t lightMismatches = controllerMismatches();
+    if(lightMismatches) fprintf(stderr, "TrafficLightSystem differs from the polling model on %zu ticks\n", lightMismatches);
+    return mismatches || lightMismatches ? 1 : 0;
+}
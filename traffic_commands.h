@@ -0,0 +1,128 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include "traffic_core.h"
+#include "traffic_sync.h"
+
+// Operator commands. Any thread submits them to a CommandQueue; the simulation thread
+// drains the queue at a tick boundary, before the tick runs, so a command always takes
+// effect between two whole ticks. Each command is stamped when submitted and when
+// applied, which gives the operator latency directly.
+
+enum class CommandType : uint8_t { SetLightState, CycleLight, SetManual, SetEmergency, AdjustSpawn, Pause };
+
+// Applied only while the controller is under manual control; dropped otherwise.
+const uint8_t kCommandManualOnly = 1;
+// value of a switch command (SetManual, SetEmergency, Pause) that flips it.
+const uint8_t kCommandToggle = 2;
+
+struct Command {
+    CommandType type = CommandType::Pause;
+    uint8_t head = 0;   // SetLightState, CycleLight: 0..3 = N, S, E, W
+    uint8_t value = 0;  // SetLightState: a LightState; switches: 0, 1 or kCommandToggle
+    uint8_t flags = 0;
+    float delta = 0;    // AdjustSpawn: seconds added to both spawn intervals
+    uint64_t submitNs = 0, applyNs = 0;
+    uint64_t tick = 0;  // tick the command took effect before
+};
+
+using CommandQueue = MpscQueue<Command, 1024>;
+
+inline uint64_t commandClockNs(){
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// False if the queue is full; the command is dropped.
+inline bool submitCommand(CommandQueue& q, Command c){
+    c.submitNs = commandClockNs();
+    return q.push(c);
+}
+
+inline IndividualLight& commandHead(World& w, uint8_t head){
+    return head == 0 ? w.light.north : head == 1 ? w.light.south : head == 2 ? w.light.east : w.light.west;
+}
+
+// Shortening stops at 0.6 s, or at the interval itself if it started out shorter
+// (--spawn); lengthening always applies in full.
+inline float adjustSpawnInterval(float interval, float delta){
+    float next = interval + delta;
+    return delta < 0 ? std::max(next, std::min(interval, 0.6f)) : next;
+}
+
+// Returns false if the command did not apply (manual-only outside manual control).
+inline bool applyCommand(World& w, const Command& c){
+    if((c.flags & kCommandManualOnly) && !w.light.manual) return false;
+    auto flip = [&](bool current){ return c.value == kCommandToggle ? !current : c.value != 0; };
+    switch(c.type){
+    case CommandType::SetLightState:
+        commandHead(w, c.head).setState(LightState(std::min<uint8_t>(c.value, 2)));
+        break;
+    case CommandType::CycleLight: {
+        IndividualLight& l = commandHead(w, c.head);
+        l.setState(l.state == LightState::RED ? LightState::YELLOW : l.state == LightState::YELLOW ? LightState::GREEN : LightState::RED);
+        break;
+    }
+    case CommandType::SetManual: w.light.setManual(flip(w.light.manual)); break;
+    case CommandType::SetEmergency: w.light.setEmergencyMode(flip(w.light.emergencyMode)); break;
+    case CommandType::AdjustSpawn:
+        w.spawnIntervalNS = adjustSpawnInterval(w.spawnIntervalNS, c.delta);
+        w.spawnIntervalEW = adjustSpawnInterval(w.spawnIntervalEW, c.delta);
+        break;
+    case CommandType::Pause: w.paused = flip(w.paused); break;
+    }
+    return true;
+}
+
+// Submit-to-apply latency of applied commands.
+struct CommandLatency {
+    uint64_t count = 0, sumNs = 0, maxNs = 0;
+    uint64_t overTick = 0; // applied more than one tick after submission
+    uint64_t skipped = 0;  // manual-only commands dropped outside manual control
+
+    void add(const Command& c, uint64_t tickNs){
+        uint64_t ns = c.applyNs > c.submitNs ? c.applyNs - c.submitNs : 0;
+        count++; sumNs += ns;
+        maxNs = std::max(maxNs, ns);
+        overTick += ns > tickNs;
+    }
+    double meanUs() const { return count ? double(sumNs) / double(count) * 1e-3 : 0.0; }
+};
+
+// Applies every queued command ahead of tick, stamping each, and calls done(command,
+// applied) for each in submission order (per producer).
+template<class F>
+size_t applyCommands(World& w, CommandQueue& q, uint64_t tick, uint64_t tickNs, CommandLatency& stats, F&& done){
+    size_t n = 0;
+    Command c;
+    while(q.pop(c)){
+        bool applied = applyCommand(w, c);
+        c.applyNs = commandClockNs();
+        c.tick = tick;
+        if(applied) stats.add(c, tickNs);
+        else stats.skipped++;
+        done(c, applied);
+        n++;
+    }
+    return n;
+}
+
+// One line describing the state an applied command left the world in.
+inline void printCommand(const World& w, const Command& c){
+    static const char* heads[4] = { "North", "South", "East", "West" };
+    static const char* states[3] = { "RED", "YELLOW", "GREEN" };
+    switch(c.type){
+    case CommandType::SetLightState:
+    case CommandType::CycleLight:
+        printf("%s light: %s\n", heads[c.head & 3],
+               states[int(c.head == 0 ? w.light.north.state : c.head == 1 ? w.light.south.state
+                          : c.head == 2 ? w.light.east.state : w.light.west.state)]);
+        break;
+    case CommandType::SetManual: printf("Traffic Light: %s mode\n", w.light.manual ? "Manual" : "Automatic"); break;
+    case CommandType::SetEmergency: printf("Emergency mode %s\n", w.light.emergencyMode ? "on" : "cleared"); break;
+    case CommandType::AdjustSpawn: printf("Spawn interval: %.1f s\n", w.spawnIntervalNS); break;
+    case CommandType::Pause: printf("Simulation %s\n", w.paused ? "paused" : "running"); break;
+    }
+}
@@ -0,0 +1,215 @@
+#pragma once
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "traffic_commands.h"
+
+// Control API on a UNIX-domain stream socket. The protocol is line based: a request
+// line holds one command or a batch separated by ';', and gets exactly one response
+// line. A batch is parsed whole and applied at a single tick boundary, or not at all.
+//
+//   set <n|s|e|w> <red|yellow|green>     cycle <n|s|e|w>
+//   manual <on|off|toggle>               emergency <on|off|toggle>
+//   pause <on|off|toggle>                spawn <seconds added to both intervals>
+//   tick                                 (no-op; reports the current tick)
+//
+// Responses: "ok <tick> <commands applied>", where tick is the tick the batch took
+// effect before, or "err <index in batch> <reason>".
+//
+// The server never blocks: poll() is called by the simulation between ticks, reads
+// and writes only what the sockets accept right away, and drops clients that stop
+// reading their responses.
+class ControlServer {
+public:
+    static const size_t kMaxPending = 1 << 20;
+    uint64_t batches = 0, commands = 0;
+
+    ~ControlServer(){ close(); }
+
+    bool open(const char* socketPath){
+        close();
+        sockaddr_un addr{};
+        if(strlen(socketPath) >= sizeof(addr.sun_path)){ fprintf(stderr, "control: socket path too long\n"); return false; }
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, socketPath);
+        // A socket left behind by an earlier run is replaced; anything else is kept.
+        struct stat st;
+        if(lstat(socketPath, &st) == 0){
+            if(!S_ISSOCK(st.st_mode)){ fprintf(stderr, "control: %s exists and is not a socket\n", socketPath); return false; }
+            unlink(socketPath);
+        }
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(listenFd < 0){ perror("control: socket"); return false; }
+        if(bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, 16) < 0){
+            perror("control: bind");
+            close();
+            return false;
+        }
+        nonBlocking(listenFd);
+        path = socketPath;
+        return true;
+    }
+
+    void close(){
+        for(auto& c : clients) ::close(c.fd);
+        clients.clear();
+        if(listenFd >= 0){ ::close(listenFd); unlink(path.c_str()); }
+        listenFd = -1;
+    }
+
+    // Accepts new clients, applies every complete request line to w ahead of tick and
+    // queues the responses. Calls done(command) for each command applied, in order.
+    // Returns the number of commands applied.
+    size_t poll(World& w, uint64_t tick){ return poll(w, tick, [](const Command&){}); }
+
+    template<class F>
+    size_t poll(World& w, uint64_t tick, F&& done){
+        if(listenFd < 0) return 0;
+        for(int fd; (fd = accept(listenFd, nullptr, nullptr)) >= 0;){
+            nonBlocking(fd);
+#ifdef SO_NOSIGPIPE
+            int one = 1; setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+            clients.push_back(Client{fd, std::string(), std::string(), false});
+        }
+        size_t applied = 0;
+        for(size_t i = 0; i < clients.size();){
+            Client& c = clients[i];
+            bool open = c.eof || receive(c);
+            // Once the peer has stopped writing, an unterminated last line is a request too.
+            if(c.eof && !c.in.empty() && c.in.back() != '\n') c.in += '\n';
+            size_t start = 0;
+            for(size_t nl; (nl = c.in.find('\n', start)) != std::string::npos; start = nl + 1){
+                c.in[nl] = 0;
+                applied += request(w, tick, &c.in[start], c.out, done);
+            }
+            c.in.erase(0, start);
+            if(open) open = transmit(c);
+            // A half-closed client still gets every response before it is dropped.
+            if(!open || (c.eof && c.out.empty()) || c.out.size() > kMaxPending || c.in.size() > kMaxPending){
+                ::close(c.fd);
+                clients.erase(clients.begin() + i);
+                continue;
+            }
+            i++;
+        }
+        return applied;
+    }
+
+private:
+    // eof: the peer shut down its writing side; responses are still owed.
+    struct Client { int fd; std::string in, out; bool eof; };
+    int listenFd = -1;
+    std::string path;
+    std::vector<Client> clients;
+    std::vector<Command> batch;
+
+    static void nonBlocking(int fd){ fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK); }
+
+    // False if the connection failed; end of input only sets eof.
+    static bool receive(Client& c){
+        char buf[4096];
+        for(;;){
+            ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+            if(n > 0){ c.in.append(buf, size_t(n)); continue; }
+            if(n == 0){ c.eof = true; return true; }
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+    }
+
+    static bool transmit(Client& c){
+#ifdef MSG_NOSIGNAL
+        const int flags = MSG_NOSIGNAL;
+#else
+        const int flags = 0;
+#endif
+        while(!c.out.empty()){
+            ssize_t n = send(c.fd, c.out.data(), c.out.size(), flags);
+            if(n > 0){ c.out.erase(0, size_t(n)); continue; }
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+        }
+        return true;
+    }
+
+    template<class F>
+    size_t request(World& w, uint64_t tick, char* line, std::string& out, F& done){
+        char reply[96];
+        batch.clear();
+        int index = 0;
+        for(char* cmd = line; cmd; index++){
+            char* next = strchr(cmd, ';');
+            if(next) *next++ = 0;
+            const char* err = parse(cmd);
+            if(err){
+                snprintf(reply, sizeof(reply), "err %d %s\n", index, err);
+                out += reply;
+                return 0;
+            }
+            cmd = next;
+        }
+        for(Command& c : batch){
+            c.tick = tick;
+            applyCommand(w, c);
+            done(c);
+        }
+        batches++;
+        commands += batch.size();
+        snprintf(reply, sizeof(reply), "ok %llu %zu\n", (unsigned long long)tick, batch.size());
+        out += reply;
+        return batch.size();
+    }
+
+    // Appends the command in text to batch; returns an error message if malformed.
+    const char* parse(char* text){
+        char* words[3] = {};
+        int n = 0;
+        char* save = nullptr;
+        for(char* t = strtok_r(text, " \t\r", &save); t; t = strtok_r(nullptr, " \t\r", &save)){
+            if(n == 3) return "too many arguments";
+            words[n++] = t;
+        }
+        if(n == 0) return nullptr;
+        Command c;
+        const char* verb = words[0];
+        auto head = [](const char* s) -> int {
+            return !strcmp(s, "n") ? 0 : !strcmp(s, "s") ? 1 : !strcmp(s, "e") ? 2 : !strcmp(s, "w") ? 3 : -1;
+        };
+        auto toggle = [](const char* s) -> int {
+            return !strcmp(s, "on") ? 1 : !strcmp(s, "off") ? 0 : !strcmp(s, "toggle") ? int(kCommandToggle) : -1;
+        };
+        if(!strcmp(verb, "tick")){
+            return n == 1 ? nullptr : "tick takes no arguments";
+        } else if(!strcmp(verb, "set")){
+            if(n != 3 || head(words[1]) < 0) return "usage: set <n|s|e|w> <red|yellow|green>";
+            const char* s = words[2];
+            int state = !strcmp(s, "red") ? 0 : !strcmp(s, "yellow") ? 1 : !strcmp(s, "green") ? 2 : -1;
+            if(state < 0) return "usage: set <n|s|e|w> <red|yellow|green>";
+            c.type = CommandType::SetLightState; c.head = uint8_t(head(words[1])); c.value = uint8_t(state);
+        } else if(!strcmp(verb, "cycle")){
+            if(n != 2 || head(words[1]) < 0) return "usage: cycle <n|s|e|w>";
+            c.type = CommandType::CycleLight; c.head = uint8_t(head(words[1]));
+        } else if(!strcmp(verb, "manual") || !strcmp(verb, "emergency") || !strcmp(verb, "pause")){
+            if(n != 2 || toggle(words[1]) < 0) return "usage: manual|emergency|pause <on|off|toggle>";
+            c.type = verb[0] == 'm' ? CommandType::SetManual : verb[0] == 'e' ? CommandType::SetEmergency : CommandType::Pause;
+            c.value = uint8_t(toggle(words[1]));
+        } else if(!strcmp(verb, "spawn")){
+            char* end = nullptr;
+            c.delta = n == 2 ? strtof(words[1], &end) : 0;
+            if(n != 2 || !end || *end) return "usage: spawn <seconds>";
+            c.type = CommandType::AdjustSpawn;
+        } else {
+            return "unknown command";
+        }
+        batch.push_back(c);
+        return nullptr;
+    }
+};
@@ -0,0 +1,614 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include "traffic_signals.h"
+#include "traffic_vehicles.h"
+
+// GL-free simulation core shared by traffic_system (windowed) and traffic_headless.
+
+enum class LightState { RED, YELLOW, GREEN };
+
+class TrafficLightSystem;
+
+// One signal head. Its timing lives in the owning TrafficLightSystem, which setState
+// notifies so the transition timer restarts; a light outside a system just holds state.
+class IndividualLight {
+public:
+    LightState state = LightState::RED;
+    float greenTime = 7.0f;
+    float yellowTime = 2.0f;
+    bool manual = false;
+    TrafficLightSystem* owner = nullptr;
+
+    inline void setState(LightState s);
+};
+
+// Elapsed time that only counts while running, in microseconds.
+struct Stopwatch {
+    uint64_t saved = 0, since = 0;
+    bool running = false;
+
+    void reset(uint64_t now){ saved = 0; since = now; }
+    void run(bool on, uint64_t now){
+        if(on == running) return;
+        if(running) saved += now - since;
+        else since = now;
+        running = on;
+    }
+    uint64_t elapsed(uint64_t now) const { return running ? saved + (now - since) : saved; }
+    // Clock time at which the elapsed time reaches limit, if running.
+    uint64_t reaches(uint64_t limit) const { return since + (limit > saved ? limit - saved : 0); }
+};
+
+// Under automatic control the controller walks a compiled SignalPlan (two-phase by
+// default). Signal timing is event-driven: each transition (plan step, head
+// green/yellow timeout, emergency timeout) is a deadline in integer microseconds, set
+// once when its interval starts and paused or resumed when the mode changes, and it
+// fires on the first tick that ends at or after it. The earliest deadline is cached as
+// dueAt(), so update() on a tick in which nothing is due is one add and one compare,
+// and a scheduler over many controllers (Network) can skip them until then with tickTo.
+class TrafficLightSystem {
+public:
+    IndividualLight north, south, east, west;
+    bool manual = false;
+    bool emergencyMode = false;
+    // Shared, not copied: the stock plans are static tables.
+    const SignalPlan* plan = &kTwoPhasePlan;
+    uint16_t step = 0;
+    // Movements (MOVE_* bits) with vehicles waiting or approaching, set by the world
+    // before every tick it runs the controller. It extends an actuated green up to its
+    // maxGreen.
+    uint8_t demand = 0;
+    // Emergencies ended by the 30 s timeout so far; the apps report new ones.
+    uint32_t emergencyTimeouts = 0;
+
+    TrafficLightSystem(){ bind(); applyStep(); refresh(0); }
+    TrafficLightSystem(const TrafficLightSystem& o){ *this = o; }
+    TrafficLightSystem& operator=(const TrafficLightSystem& o){
+        north = o.north; south = o.south; east = o.east; west = o.west;
+        manual = o.manual; emergencyMode = o.emergencyMode;
+        plan = o.plan; step = o.step; demand = o.demand; emergencyTimeouts = o.emergencyTimeouts;
+        clock = o.clock; due = o.due;
+        for(uint32_t id = 0; id < kTimers; id++) expires[id] = o.expires[id];
+        stepSeconds = o.stepSeconds; stepMicros = o.stepMicros;
+        for(int i = 0; i < 4; i++) lightWatch[i] = o.lightWatch[i];
+        stepWatch = o.stepWatch; emergencyWatch = o.emergencyWatch;
+        bind();
+        return *this;
+    }
+
+    // Starts plan p at step first, offset seconds into it (for coordinated offsets).
+    // p must outlive the controller.
+    void setPlan(const SignalPlan& p, uint16_t first = 0, float offset = 0.0f) {
+        plan = &p;
+        step = first < p.count ? first : 0;
+        applyStep();
+        stepWatch.reset(clock);
+        stepWatch.saved = micros(offset);
+        refresh(clock);
+    }
+
+    void setManual(bool on) {
+        manual = on;
+        north.manual = on;
+        south.manual = on;
+        east.manual = on;
+        west.manual = on;
+        refresh(clock);
+    }
+
+    void setEmergencyMode(bool on) {
+        emergencyMode = on;
+        emergencyWatch.reset(clock);
+        refresh(clock);
+    }
+
+    void update(float dt) {
+        if(dt != stepSeconds) { stepSeconds = dt; stepMicros = micros(dt); }
+        tickTo(clock + stepMicros, stepMicros);
+    }
+
+    // Runs the tick of tickUs microseconds that ends at clock time at. Ticks since the
+    // last one may have been skipped, provided nothing fell due before this one began.
+    void tickTo(uint64_t at, uint64_t tickUs) {
+        clock = at;
+        // Nothing due, emergency timeout included.
+        if(clock < due) return;
+        // The emergency timeout is settled first; once it clears, the whole tick
+        // counts towards the plan and none of it towards the head timers.
+        if(emergencyMode && expires[kEmergency] <= clock) {
+            cancel(kEmergency);
+            emergencyMode = false;
+            emergencyTimeouts++;
+            refresh(at - tickUs);
+        }
+        // Due deadlines in expiry order. Whatever fire() sets lies past the clock, except
+        // a head timeout of zero, which fires again here and ends at red.
+        while(due <= clock) {
+            uint32_t id = 0;
+            for(uint32_t i = 1; i < kTimers; i++) if(expires[i] < expires[id]) id = i;
+            cancel(id);
+            fire(id);
+        }
+    }
+
+    // Moves the clock to at between ticks, for a controller whose idle ticks were
+    // skipped; nothing may be due by then.
+    void setClock(uint64_t at) { clock = at; }
+
+    static const uint64_t kNever = ~0ull;
+    // Clock time of the earliest deadline, or kNever.
+    uint64_t dueAt() const { return due; }
+
+    static uint64_t micros(float seconds) { return uint64_t(std::llround(double(seconds) * 1e6)); }
+
+    // Seconds of update() until any light or the mode changes, or -1 if nothing is
+    // pending (manual control).
+    float nextChangeIn() const {
+        if(due == kNever) return -1.0f;
+        return float(double(due > clock ? due - clock : 0) * 1e-6);
+    }
+
+    // Restarts the head timer of l; called by IndividualLight::setState.
+    void lightChanged(IndividualLight& l) {
+        int i = index(l);
+        if(i < 0) return;
+        lightWatch[i].reset(clock);
+        armLight(i);
+    }
+
+    bool nsProceed() const { return north.state == LightState::GREEN || south.state == LightState::GREEN; }
+    bool ewProceed() const { return east.state == LightState::GREEN || west.state == LightState::GREEN; }
+
+private:
+    enum : uint32_t { kNorth, kSouth, kEast, kWest, kStep, kEmergency, kTimers };
+    uint64_t clock = 0;
+    float stepSeconds = 0.0f;
+    uint64_t stepMicros = 0;
+    uint64_t expires[kTimers] = { kNever, kNever, kNever, kNever, kNever, kNever };
+    uint64_t due = kNever; // earliest of expires
+
+    // A deadline already passed fires on the next update.
+    void arm(uint32_t id, uint64_t at) {
+        cancel(id);
+        expires[id] = at;
+        due = std::min(due, at);
+    }
+    void cancel(uint32_t id) {
+        if(expires[id] == kNever) return;
+        const bool earliest = expires[id] == due;
+        expires[id] = kNever;
+        if(!earliest) return;
+        due = kNever;
+        for(uint64_t e : expires) due = std::min(due, e);
+    }
+    Stopwatch lightWatch[4], stepWatch, emergencyWatch;
+
+    IndividualLight& light(int i) { return i == 0 ? north : i == 1 ? south : i == 2 ? east : west; }
+    int index(const IndividualLight& l) const {
+        return &l == &north ? 0 : &l == &south ? 1 : &l == &east ? 2 : &l == &west ? 3 : -1;
+    }
+
+    void bind() { north.owner = this; south.owner = this; east.owner = this; west.owner = this; }
+
+    // Re-derives which timers run for the current mode as of time at and re-arms them.
+    // The plan runs under automatic control; the head timers run otherwise, unless the
+    // head itself is under manual control.
+    void refresh(uint64_t at) {
+        stepWatch.run(!manual && !emergencyMode && plan->count, at);
+        if(stepWatch.running) arm(kStep, stepWatch.reaches(plan->steps[step].minUs));
+        else cancel(kStep);
+        emergencyWatch.run(emergencyMode, at);
+        if(emergencyMode) arm(kEmergency, emergencyWatch.reaches(30000000));
+        else cancel(kEmergency);
+        for(int i = 0; i < 4; i++) {
+            lightWatch[i].run((manual || emergencyMode) && !light(i).manual, at);
+            armLight(i);
+        }
+    }
+
+    void armLight(int i) {
+        const IndividualLight& l = light(i);
+        if(!lightWatch[i].running || l.state == LightState::RED) { cancel(uint32_t(i)); return; }
+        float limit = l.state == LightState::GREEN ? l.greenTime : l.yellowTime;
+        arm(uint32_t(i), lightWatch[i].reaches(micros(limit)));
+    }
+
+    void fire(uint32_t id) {
+        if(id < 4) {
+            IndividualLight& l = light(int(id));
+            l.setState(l.state == LightState::GREEN ? LightState::YELLOW : LightState::RED);
+        } else if(id == kStep) {
+            const SignalStep& cur = plan->steps[step];
+            uint64_t elapsed = stepWatch.elapsed(clock);
+            if((demand & cur.movements) && elapsed < cur.maxUs) {
+                uint64_t until = std::min<uint64_t>(elapsed + plan->passageUs, cur.maxUs);
+                arm(kStep, stepWatch.reaches(until));
+                return;
+            }
+            step = cur.next;
+            applyStep();
+            stepWatch.reset(clock);
+            arm(kStep, stepWatch.reaches(plan->steps[step].minUs));
+        }
+    }
+
+    void applyStep() {
+        if(!plan->count) return;
+        uint8_t heads = plan->steps[step].heads;
+        for(int i = 0; i < 4; i++) light(i).setState(LightState(heads >> (2*i) & 3));
+    }
+};
+
+inline void IndividualLight::setState(LightState s) {
+    state = s;
+    if(owner) owner->lightChanged(*this);
+}
+
+// Cars of each (axis, lane) in entry order. Cars never overtake inside a lane, so
+// entry order is also front-to-back order and a car's leader sits just before it.
+class LaneIndex {
+public:
+    static const int kLanes = 8;
+    static const uint32_t kNone = 0xffffffffu;
+    std::vector<uint32_t> lanes[kLanes];
+
+    static int key(char axis, int lane){
+        int a = axis=='N' ? 0 : axis=='S' ? 1 : axis=='E' ? 2 : 3;
+        return a*2 + (lane & 1);
+    }
+
+    void push(const Car& c, uint32_t index){ lanes[key(c.axis, c.lane)].push_back(index); }
+
+    // The car that entered lane k last, which is also the one furthest back.
+    uint32_t last(int k) const { return lanes[k].empty() ? kNone : lanes[k].back(); }
+
+    void clear(){ for(auto& lane : lanes) lane.clear(); }
+};
+
+// Fixed-step scheduler. Frame time is accumulated and drained in whole steps so
+// World::update always sees the same dt regardless of frame rate; a long hitch is
+// capped at maxSteps and the rest of the backlog dropped instead of replayed.
+class FixedStepClock {
+public:
+    double step = 1.0 / 120.0;
+    int maxSteps = 8;
+    double accumulator = 0.0;
+    long long ticks = 0;
+
+    int advance(double frameDt){
+        accumulator += frameDt;
+        int n = int(accumulator / step);
+        if(n > maxSteps){
+            n = maxSteps;
+            accumulator = std::fmod(accumulator, step);
+        } else {
+            accumulator = std::max(0.0, accumulator - n * step);
+        }
+        ticks += n;
+        return n;
+    }
+
+    // How far the frame is between the last two simulated states, in [0, 1).
+    float alpha() const { return float(accumulator / step); }
+};
+
+class World {
+public:
+    TrafficLightSystem light;
+    VehicleStore cars;
+    LaneIndex lanes;
+    float spawnIntervalNS = 2.2f;
+    float spawnIntervalEW = 2.2f;
+    float spawnTimerNS = 0.f;
+    float spawnTimerEW = 0.f;
+    bool paused=false;
+    // In a grid, approaches fed by a neighbor do not spawn, and cars leaving the
+    // bounds are collected in exits for hand-off instead of being dropped.
+    bool spawnN=true, spawnS=true, spawnE=true, spawnW=true;
+    bool handoff=false;
+    std::vector<Car> exits;
+    // Set by a renderer that interpolates: update() then saves each car's position as
+    // px/py before moving it. Nothing else reads them, so other runs skip the copy.
+    bool keepPrevious=false;
+    // Approaches that spawned a car in the last update: bit 0..3 for N, S, E, W.
+    uint8_t spawned = 0;
+    // Cars that have left the bounds, handed off or not.
+    long long exited = 0;
+    // Last car of the downstream lane in this node's frame, refreshed by the grid
+    // every tick. A lane's head car keeps its headway to it like to any leader.
+    bool ghost[LaneIndex::kLanes]{};
+    float ghostX[LaneIndex::kLanes]{}, ghostY[LaneIndex::kLanes]{};
+    const float stopNS = 2.5f;
+    const float stopEW = 4.0f;
+    const float roadHalf = 3.0f;
+    // Signal rule: hold within stopGap of a red stop line, or before the go-on-yellow
+    // point of a yellow one; never inside the box or once 0.5 past the line.
+    static constexpr float kStopGap = 1.6f;
+    static constexpr float kGoOnYellow = 1.0f;
+    static constexpr float kPastLine = -0.5f;
+    static constexpr float kInterHalf = 1.5f;
+    // A follower holds while its leader is within its own length plus kHeadway ahead.
+    static constexpr float kHeadway = 1.8f;
+    // Cars leave the world past these half extents.
+    static constexpr float kBoundX = 22.0f, kBoundY = 14.0f;
+    // Per-lane scratch for computeStopMask, kept to avoid reallocating every tick.
+    std::vector<float> laneX, laneY;
+    std::vector<uint8_t> laneHold;
+
+    static bool outOfBounds(float x, float y){ return std::abs(x)>kBoundX || std::abs(y)>kBoundY; }
+
+    void addCar(const Car& c){
+        Car n = c;
+        n.markPrevious();
+        lanes.push(n, cars.acquire(n));
+    }
+
+    // Walks forward from slot k of a lane; only cars closer than the headway window
+    // are visited, so this is O(1) per car instead of a scan of the whole fleet.
+    // Leaders were decided earlier in the same pass, so they are seen at the
+    // position they reach this tick (and skipped if that takes them out of bounds).
+    bool hasFrontCarTooClose(int laneKey, size_t k, float dt) const {
+        const VehicleStore& s = cars;
+        const std::vector<uint32_t>& lane = lanes.lanes[laneKey];
+        const uint32_t me = lane[k];
+        const float mx = s.x[me], my = s.y[me];
+        // 1 = too close, 0 = clear and nothing further ahead matters, -1 = keep looking.
+        auto check = [&](float cx, float cy) -> int {
+            float gap, lateral, reach;
+            if(s.vx[me]>0){ gap = cx - mx; lateral = cy - my; reach = s.w[me] + kHeadway; }
+            else if(s.vx[me]<0){ gap = mx - cx; lateral = cy - my; reach = s.w[me] + kHeadway; }
+            else if(s.vy[me]>0){ gap = cy - my; lateral = cx - mx; reach = s.h[me] + kHeadway; }
+            else if(s.vy[me]<0){ gap = my - cy; lateral = cx - mx; reach = s.h[me] + kHeadway; }
+            else return 0;
+            if(gap >= reach) return 0;
+            if(gap > 0 && std::abs(lateral) < 0.8f) return 1;
+            return -1;
+        };
+        for(size_t j = k; j-- > 0;){
+            const uint32_t o = lane[j];
+            if(!s.active[o]) continue;
+            float cx = s.x[o], cy = s.y[o];
+            if(!s.stop[o]){
+                float dx = s.vx[o]*s.speed[o]; dx = dx*dt;
+                float dy = s.vy[o]*s.speed[o]; dy = dy*dt;
+                cx = cx + dx; cy = cy + dy;
+            }
+            if(outOfBounds(cx, cy)) continue;
+            int r = check(cx, cy);
+            if(r >= 0) return r == 1;
+        }
+        return ghost[laneKey] && check(ghostX[laneKey], ghostY[laneKey]) == 1;
+    }
+
+    // Signed distance to the approach's stop line along the direction of travel;
+    // negative once the car is past it.
+    float stopLineDistance(float x, float y, char axis) const {
+        if(axis=='N') return (-stopNS) - y;
+        if(axis=='S') return y - stopNS;
+        if(axis=='E') return (-stopEW) - x;
+        return x - stopEW;
+    }
+
+    // Movements with a car at most detectorRange short of the stop line, for actuated
+    // plans. Lanes run front to back, so only cars already past the line are skipped.
+    uint8_t detectDemand() const {
+        const float detectorRange = 12.0f;
+        uint8_t mask = 0;
+        for(int L = 0; L < LaneIndex::kLanes; L++){
+            for(uint32_t i : lanes.lanes[L]){
+                if(!cars.active[i]) continue;
+                float dist = stopLineDistance(cars.x[i], cars.y[i], char(cars.axis[i]));
+                if(dist < 0) continue;
+                if(dist <= detectorRange) mask |= uint8_t(1 << (L / 2));
+                break;
+            }
+        }
+        return mask;
+    }
+
+    bool shouldStopAtSignal(float x, float y, char axis) const {
+        if(std::abs(x) < kInterHalf && std::abs(y) < kInterHalf) return false;
+        if(axis=='N'){
+            float dist = (-stopNS) - y;
+            if(dist < kPastLine) return false;
+            if(light.north.state == LightState::GREEN) return false;
+            if(light.north.state == LightState::YELLOW){ return !(dist <= kGoOnYellow); }
+            return dist <= kStopGap;
+        } else if(axis=='S'){
+            float dist = y - stopNS;
+            if(dist < kPastLine) return false;
+            if(light.south.state == LightState::GREEN) return false;
+            if(light.south.state == LightState::YELLOW){ return !(dist <= kGoOnYellow); }
+            return dist <= kStopGap;
+        } else if(axis=='E'){
+            float dist = (-stopEW) - x;
+            if(dist < kPastLine) return false;
+            if(light.east.state == LightState::GREEN) return false;
+            if(light.east.state == LightState::YELLOW){ return !(dist <= kGoOnYellow); }
+            return dist <= kStopGap;
+        } else if(axis=='W'){
+            float dist = x - stopEW;
+            if(dist < kPastLine) return false;
+            if(light.west.state == LightState::GREEN) return false;
+            if(light.west.state == LightState::YELLOW){ return !(dist <= kGoOnYellow); }
+            return dist <= kStopGap;
+        }
+        return false;
+    }
+
+    // shouldStopAtSignal for n cars of one approach at once. They share the light and
+    // the stop line, so the state is branched on once and the rest is a few compares
+    // per car. dist is formed as sign*along - line, which rounds exactly like the
+    // per-car expressions, and the negated compares keep NaN handling identical too.
+    void signalStopMask(const float* x, const float* y, size_t n, char axis, uint8_t* hold) const {
+        LightState state = axis=='N' ? light.north.state : axis=='S' ? light.south.state
+                         : axis=='E' ? light.east.state : light.west.state;
+        if(state == LightState::GREEN){ std::fill(hold, hold + n, uint8_t(0)); return; }
+        const bool yellow = state == LightState::YELLOW;
+        const bool ns = axis=='N' || axis=='S';
+        const float* along = ns ? y : x;
+        const float sign = (axis=='N' || axis=='E') ? -1.0f : 1.0f;
+        const float line = ns ? stopNS : stopEW;
+        size_t i = 0;
+#if defined(__AVX2__)
+        const __m256 vsign = _mm256_set1_ps(sign), vline = _mm256_set1_ps(line);
+        const __m256 half = _mm256_set1_ps(kInterHalf), past = _mm256_set1_ps(kPastLine);
+        const __m256 limit = _mm256_set1_ps(yellow ? kGoOnYellow : kStopGap);
+        const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        for(; i + 8 <= n; i += 8){
+            __m256 x8 = _mm256_loadu_ps(x + i), y8 = _mm256_loadu_ps(y + i);
+            __m256 box = _mm256_and_ps(_mm256_cmp_ps(_mm256_and_ps(x8, absMask), half, _CMP_LT_OQ),
+                                       _mm256_cmp_ps(_mm256_and_ps(y8, absMask), half, _CMP_LT_OQ));
+            __m256 dist = _mm256_sub_ps(_mm256_mul_ps(vsign, _mm256_loadu_ps(along + i)), vline);
+            __m256 m = _mm256_cmp_ps(dist, past, _CMP_NLT_UQ);
+            m = _mm256_and_ps(m, yellow ? _mm256_cmp_ps(dist, limit, _CMP_NLE_UQ) : _mm256_cmp_ps(dist, limit, _CMP_LE_OQ));
+            __m256i h = _mm256_castps_si256(_mm256_andnot_ps(box, m));
+            __m128i h16 = _mm_packs_epi32(_mm256_castsi256_si128(h), _mm256_extracti128_si256(h, 1));
+            _mm_storel_epi64((__m128i*)(hold + i), _mm_and_si128(_mm_packs_epi16(h16, h16), _mm_set1_epi8(1)));
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
+        const __m128 vsign = _mm_set1_ps(sign), vline = _mm_set1_ps(line);
+        const __m128 half = _mm_set1_ps(kInterHalf), past = _mm_set1_ps(kPastLine);
+        const __m128 limit = _mm_set1_ps(yellow ? kGoOnYellow : kStopGap);
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        for(; i + 4 <= n; i += 4){
+            __m128 x4 = _mm_loadu_ps(x + i), y4 = _mm_loadu_ps(y + i);
+            __m128 box = _mm_and_ps(_mm_cmplt_ps(_mm_and_ps(x4, absMask), half),
+                                    _mm_cmplt_ps(_mm_and_ps(y4, absMask), half));
+            __m128 dist = _mm_sub_ps(_mm_mul_ps(vsign, _mm_loadu_ps(along + i)), vline);
+            __m128 m = _mm_cmpnlt_ps(dist, past);
+            m = _mm_and_ps(m, yellow ? _mm_cmpnle_ps(dist, limit) : _mm_cmple_ps(dist, limit));
+            __m128i h = _mm_castps_si128(_mm_andnot_ps(box, m));
+            h = _mm_packs_epi32(h, h);
+            int32_t h4 = _mm_cvtsi128_si32(_mm_packs_epi16(h, h)) & 0x01010101;
+            memcpy(hold + i, &h4, 4);
+        }
+#endif
+        for(; i < n; i++){
+            bool box = std::abs(x[i]) < kInterHalf && std::abs(y[i]) < kInterHalf;
+            float dist = sign*along[i] - line;
+            bool m = !(dist < kPastLine) && (yellow ? !(dist <= kGoOnYellow) : dist <= kStopGap);
+            hold[i] = uint8_t(!box && m);
+        }
+    }
+
+    // Cars never overtake, so within a lane they leave the bounds front first and only
+    // the front of each lane needs checking.
+    void cullCars(){
+        for(auto& lane : lanes.lanes){
+            size_t k = 0;
+            while(k < lane.size() && outOfBounds(cars.x[lane[k]], cars.y[lane[k]])){
+                if(handoff) exits.push_back(cars.get(lane[k]));
+                cars.release(lane[k]);
+                exited++;
+                k++;
+            }
+            if(k) lane.erase(lane.begin(), lane.begin() + k);
+        }
+    }
+
+    // Retires one car wherever it is in its lane.
+    void retireCar(uint32_t i){
+        auto& lane = lanes.lanes[LaneIndex::key(char(cars.axis[i]), cars.lane[i])];
+        lane.erase(std::find(lane.begin(), lane.end(), i));
+        if(handoff) exits.push_back(cars.get(i));
+        cars.release(i);
+        exited++;
+    }
+
+    // Clearance is tested against the last car of the lane only. Every car of a lane
+    // shares its cross coordinate and none overtakes, so the last one is nearest the
+    // spawn point; the N/S window reaches back beyond the bounds, so it holds any car
+    // of the lane. Either way the answer equals a test over the whole lane.
+    void spawnCars(float dt){
+        spawnTimerNS += dt; spawnTimerEW += dt;
+        spawned = 0;
+        const VehicleStore& s = cars;
+        if(spawnTimerNS >= spawnIntervalNS){
+            spawnTimerNS = 0.f;
+            Car cN; cN.lane=0; cN.axis='N'; cN.active=true;
+            cN.x = -1.0f; cN.y = -12.5f; cN.vx=0; cN.vy=1;
+            Car cS; cS.lane=1; cS.axis='S'; cS.active=true;
+            cS.x = 1.0f; cS.y = 12.5f; cS.vx=0; cS.vy=-1;
+            uint32_t tN = lanes.last(LaneIndex::key('N', 0)), tS = lanes.last(LaneIndex::key('S', 1));
+            bool okN = tN == LaneIndex::kNone || !(std::abs(s.x[tN]-cN.x)<0.8f && (cN.y - s.y[tN]) < 4.0f);
+            bool okS = tS == LaneIndex::kNone || !(std::abs(s.x[tS]-cS.x)<0.8f && (s.y[tS] - cS.y) < 4.0f);
+            if(okN && spawnN){ addCar(cN); spawned |= 1; }
+            if(okS && spawnS){ addCar(cS); spawned |= 2; }
+        }
+        if(spawnTimerEW >= spawnIntervalEW){
+            spawnTimerEW = 0.f;
+            Car cE; cE.lane=0; cE.axis='E'; cE.active=true;
+            cE.y = -1.0f; cE.x = -20.5f; cE.vx=1; cE.vy=0;
+            Car cW; cW.lane=1; cW.axis='W'; cW.active=true;
+            cW.y = 1.0f; cW.x = 20.5f; cW.vx=-1; cW.vy=0;
+            uint32_t tE = lanes.last(LaneIndex::key('E', 0)), tW = lanes.last(LaneIndex::key('W', 1));
+            bool okE = tE == LaneIndex::kNone || !(std::abs(s.y[tE]-cE.y)<0.8f && (s.x[tE] - cE.x) < 6.0f);
+            bool okW = tW == LaneIndex::kNone || !(std::abs(s.y[tW]-cW.y)<0.8f && (cW.x - s.x[tW]) < 6.0f);
+            if(okE && spawnE){ addCar(cE); spawned |= 4; }
+            if(okW && spawnW){ addCar(cW); spawned |= 8; }
+        }
+    }
+
+    // Stop mask pass: each lane front to back, so a follower sees where its leader
+    // ends up this tick exactly as the old one-car-at-a-time loop did. The signal part
+    // does not depend on other cars and is evaluated for the whole lane up front.
+    void computeStopMask(float dt){
+        for(int L = 0; L < LaneIndex::kLanes; L++){
+            const std::vector<uint32_t>& lane = lanes.lanes[L];
+            size_t n = lane.size();
+            if(!n) continue;
+            if(laneX.size() < n){ laneX.resize(n); laneY.resize(n); laneHold.resize(n); }
+            for(size_t k = 0; k < n; k++){ laneX[k] = cars.x[lane[k]]; laneY[k] = cars.y[lane[k]]; }
+            signalStopMask(laneX.data(), laneY.data(), n, "NSEW"[L / 2], laneHold.data());
+            for(size_t k = 0; k < n; k++){
+                uint32_t i = lane[k];
+                cars.stop[i] = !cars.active[i] || laneHold[k] || hasFrontCarTooClose(L, k, dt);
+            }
+        }
+    }
+
+    // With lights false the controller is left to the caller, which in a Network runs
+    // it only on ticks where one of its deadlines is due.
+    void update(float dt, bool lights = true){
+        if(keepPrevious) cars.markPrevious();
+        if(paused){ spawned = 0; return; }
+        if(lights){
+            light.demand = detectDemand();
+            light.update(dt);
+        }
+        spawnCars(dt);
+        computeStopMask(dt);
+        integrateVehicles(cars, dt);
+        cullCars();
+    }
+};
+
+// What a renderer needs of a World at one tick: the live cars and the signal state.
+// Plain data, so the simulation thread can hand it to the render thread; capture
+// reuses the storage it already has.
+struct WorldSnapshot {
+    std::vector<Car> cars;
+    LightState north = LightState::RED, south = LightState::RED;
+    LightState east = LightState::RED, west = LightState::RED;
+    bool manual = false, emergencyMode = false, paused = false;
+    float stopNS = 0, stopEW = 0, roadHalf = 0;
+    uint64_t tick = 0;
+    // When it was taken, in seconds on the publisher's clock; set by the publisher.
+    double time = 0;
+
+    void capture(const World& w, uint64_t t){
+        cars.clear();
+        for(size_t i = 0; i < w.cars.size(); i++) if(w.cars.active[i]) cars.push_back(w.cars.get(i));
+        north = w.light.north.state; south = w.light.south.state;
+        east = w.light.east.state; west = w.light.west.state;
+        manual = w.light.manual; emergencyMode = w.light.emergencyMode; paused = w.paused;
+        stopNS = w.stopNS; stopEW = w.stopEW; roadHalf = w.roadHalf;
+        tick = t;
+    }
+};
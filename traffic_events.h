@@ -0,0 +1,212 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <vector>
+#include "traffic_core.h"
+
+// Discrete-event alternative to stepping World::update at a fixed dt. Between events
+// every car either stands still or moves in a straight line at its speed, so the engine
+// keeps for each car the time its position was last written (anchor) and computes the
+// position in closed form on demand. Events sit in a min-heap and are invalidated
+// lazily: a car's version is bumped whenever its lane is re-planned or its slot is
+// retired, and popped entries with a stale version are dropped.
+//
+// Event kinds: light transitions (TrafficLightSystem::nextChangeIn), spawns, and per
+// car the earliest of reaching the stop trigger of a non-green light, closing the
+// headway to a stopped leader, the headway to a departing leader opening up again,
+// and leaving the bounds. Stop decisions reuse World::shouldStopAtSignal and
+// World::hasFrontCarTooClose. The continuous clock does not round transitions up to
+// a tick, so results track a fixed-step run closely but not bit for bit.
+// Single intersection only: grid ghosts and hand-off are not modelled.
+class EventEngine {
+public:
+    World& world;
+    double now = 0.0;
+    long long events = 0;
+    long long exited = 0;
+
+    explicit EventEngine(World& w) : world(w) { resync(); }
+
+    // Runs every event up to time t and leaves the clock there.
+    void advanceTo(double t){
+        if(world.paused){
+            // Nothing moves or counts down while paused.
+            materialize();
+            std::fill(anchor.begin(), anchor.end(), t);
+            now = lightClock = spawnClock = t;
+            resync();
+            return;
+        }
+        while(!heap.empty() && heap.top().time <= t){
+            Event e = heap.top();
+            heap.pop();
+            if(e.kind == CAR && (e.row >= version.size() || version[e.row] != e.version)) continue;
+            if(e.kind == LIGHT && e.version != lightVersion) continue;
+            if(e.kind == SPAWN && e.version != spawnVersion) continue;
+            now = e.time;
+            events++;
+            if(e.kind == LIGHT) onLight();
+            else if(e.kind == SPAWN) onSpawn();
+            else onCar(e.row);
+        }
+        now = t;
+    }
+
+    // Writes every car position at the current time into the store, e.g. to draw it.
+    void materialize(){
+        for(size_t i = 0; i < world.cars.size(); i++) place(uint32_t(i));
+    }
+
+    // Rebuilds the schedule from the world state. Call after changing the lights,
+    // spawn intervals or cars from outside the engine.
+    void resync(){
+        materialize();
+        world.light.update(float(now - lightClock)); lightClock = now;
+        advanceSpawnTimers();
+        anchor.resize(world.cars.size(), now);
+        version.resize(world.cars.size(), 0);
+        heap = decltype(heap)();
+        scheduleLight();
+        scheduleSpawn();
+        for(int L = 0; L < LaneIndex::kLanes; L++) plan(L);
+    }
+
+private:
+    enum Kind : uint8_t { LIGHT, SPAWN, CAR };
+    struct Event {
+        double time;
+        uint64_t seq;
+        uint32_t row, version;
+        Kind kind;
+        bool operator<(const Event& o) const { return time != o.time ? time > o.time : seq > o.seq; }
+    };
+    // Events fire this far past the exact crossing so the float comparisons in the
+    // stop rules see the threshold as crossed.
+    static constexpr double kEps = 1e-4;
+
+    std::priority_queue<Event> heap;
+    uint64_t seq = 0;
+    std::vector<double> anchor;
+    std::vector<uint32_t> version;
+    uint32_t lightVersion = 0, spawnVersion = 0;
+    double lightClock = 0.0, spawnClock = 0.0;
+
+    void push(double t, Kind kind, uint32_t row, uint32_t v){ heap.push(Event{t, seq++, row, v, kind}); }
+
+    void place(uint32_t i){
+        VehicleStore& s = world.cars;
+        if(s.active[i] && !s.stop[i]){
+            float d = float(now - anchor[i]);
+            s.x[i] += s.vx[i]*s.speed[i]*d;
+            s.y[i] += s.vy[i]*s.speed[i]*d;
+        }
+        anchor[i] = now;
+    }
+
+    void advanceSpawnTimers(){
+        world.spawnTimerNS += float(now - spawnClock);
+        world.spawnTimerEW += float(now - spawnClock);
+        spawnClock = now;
+    }
+
+    void scheduleLight(){
+        float t = world.light.nextChangeIn();
+        if(t >= 0) push(now + t + kEps, LIGHT, 0, ++lightVersion);
+    }
+
+    void scheduleSpawn(){
+        double t = std::min(world.spawnIntervalNS - world.spawnTimerNS, world.spawnIntervalEW - world.spawnTimerEW);
+        push(now + std::max(0.0, t) + kEps, SPAWN, 0, ++spawnVersion);
+    }
+
+    void onLight(){
+        materialize();
+        world.light.demand = world.detectDemand();
+        world.light.update(float(now - lightClock));
+        lightClock = now;
+        scheduleLight();
+        for(int L = 0; L < LaneIndex::kLanes; L++) plan(L);
+    }
+
+    // New cars land at the back of their lane, possibly in a recycled slot.
+    void onSpawn(){
+        materialize();
+        float dt = float(now - spawnClock);
+        spawnClock = now;
+        size_t before[LaneIndex::kLanes];
+        for(int L = 0; L < LaneIndex::kLanes; L++) before[L] = world.lanes.lanes[L].size();
+        world.spawnCars(dt);
+        anchor.resize(world.cars.size(), now);
+        version.resize(world.cars.size(), 0);
+        scheduleSpawn();
+        for(int L = 0; L < LaneIndex::kLanes; L++){
+            const std::vector<uint32_t>& lane = world.lanes.lanes[L];
+            if(lane.size() == before[L]) continue;
+            for(size_t k = before[L]; k < lane.size(); k++) anchor[lane[k]] = now;
+            plan(L);
+        }
+    }
+
+    void onCar(uint32_t row){
+        VehicleStore& s = world.cars;
+        place(row);
+        int L = LaneIndex::key(char(s.axis[row]), s.lane[row]);
+        if(World::outOfBounds(s.x[row], s.y[row])){
+            world.retireCar(row);
+            version[row]++;
+            exited++;
+        }
+        plan(L);
+    }
+
+    const IndividualLight& lightFor(char axis) const {
+        const TrafficLightSystem& l = world.light;
+        return axis=='N' ? l.north : axis=='S' ? l.south : axis=='E' ? l.east : l.west;
+    }
+
+    // Re-decides stop flags in lane L front to back at the current time and schedules
+    // the next event of every car in it.
+    void plan(int L){
+        VehicleStore& s = world.cars;
+        const std::vector<uint32_t>& lane = world.lanes.lanes[L];
+        for(uint32_t i : lane) place(i);
+        uint32_t leader = LaneIndex::kNone;
+        for(size_t k = 0; k < lane.size(); k++){
+            uint32_t i = lane[k];
+            version[i]++;
+            if(!s.active[i]) continue;
+            s.stop[i] = world.shouldStopAtSignal(s.x[i], s.y[i], char(s.axis[i]))
+                     || world.hasFrontCarTooClose(L, k, 0.0f);
+            double t = nextEvent(i, leader);
+            if(t >= 0) push(now + t + kEps, CAR, i, version[i]);
+            leader = i;
+        }
+    }
+
+    // Seconds until car i's stop decision can change or it leaves the bounds, assuming
+    // no other event happens first; -1 if never.
+    double nextEvent(uint32_t i, uint32_t leader) const {
+        const VehicleStore& s = world.cars;
+        double best = -1.0;
+        auto consider = [&](double t){ if(t >= 0 && (best < 0 || t < best)) best = t; };
+        const float along = s.x[i]*s.vx[i] + s.y[i]*s.vy[i];
+        const bool moving = !s.stop[i];
+        if(moving){
+            float bound = s.vx[i] != 0 ? World::kBoundX : World::kBoundY;
+            consider((bound - along) / s.speed[i]);
+            const IndividualLight& l = lightFor(char(s.axis[i]));
+            float dist = world.stopLineDistance(s.x[i], s.y[i], char(s.axis[i]));
+            if(l.state == LightState::RED && dist > World::kStopGap) consider((dist - World::kStopGap) / s.speed[i]);
+        }
+        if(leader != LaneIndex::kNone && s.active[leader]){
+            float reach = (s.vx[i] != 0 ? s.w[i] : s.h[i]) + World::kHeadway;
+            float gap = s.x[leader]*s.vx[i] + s.y[leader]*s.vy[i] - along;
+            float closing = (moving ? s.speed[i] : 0.0f) - (s.stop[leader] ? 0.0f : s.speed[leader]);
+            if(closing > 0 && gap > reach) consider((gap - reach) / closing);
+            if(closing < 0 && gap < reach) consider((reach - gap) / -closing);
+        }
+        return best;
+    }
+};
@@ -0,0 +1,244 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+#include "traffic_core.h"
+#include "traffic_pool.h"
+#include "traffic_sync.h"
+
+// N x M grid of intersections. Each node is a full World in its own local frame with
+// its own TrafficLightSystem; nodes are spaced exactly one bounds-width apart, so a
+// car leaving a node re-enters the neighbor's matching approach with only a shift of
+// its coordinates. Only approaches on the outer edge of the grid spawn traffic.
+//
+// The signal controllers are scheduled here rather than ticked by their nodes: a
+// min-heap holds each controller's next deadline, and a tick visits only the
+// controllers whose deadline it reaches, so an idle light costs nothing per tick. A
+// skipped controller's clock lags behind; code that reads or changes a node's
+// controller between updates reaches the node through touch(), which brings the clock
+// up to date and reschedules it. Before the first update the nodes may be set up
+// directly.
+class Network {
+public:
+    static constexpr float kSpanX = 44.0f;
+    static constexpr float kSpanY = 28.0f;
+    int cols=0, rows=0;
+    std::vector<World> nodes;
+    uint64_t tick=0;
+    // When set, each phase of a tick runs over the nodes in parallel. Every phase only
+    // writes the node it is handed, so the result matches the serial run bit for bit.
+    ThreadPool* pool=nullptr;
+
+    void build(int c, int r){
+        cols = c; rows = r;
+        tick = 0;
+        nodes.clear();
+        nodes.resize(size_t(c) * size_t(r));
+        links.reset(new Link[nodes.size()]);
+        lightClock = 0; tickSeconds = 0; tickUs = 0;
+        timers = Timers();
+        lightOffset.assign(nodes.size(), 0);
+        lightDue.assign(nodes.size(), 0);
+        touched.assign(nodes.size(), 0);
+        dueNodes.clear(); touchedNodes.clear();
+        scheduled = false;
+        for(int row = 0; row < r; row++){
+            for(int col = 0; col < c; col++){
+                World& w = at(col, row);
+                w.handoff = true;
+                w.spawnN = (row == 0);
+                w.spawnS = (row == r - 1);
+                w.spawnE = (col == 0);
+                w.spawnW = (col == c - 1);
+            }
+        }
+    }
+
+    World& at(int col, int row){ return nodes[size_t(row) * cols + col]; }
+    const World& at(int col, int row) const { return nodes[size_t(row) * cols + col]; }
+
+    // Node i with its controller's clock brought up to date, for reading or changing it
+    // between updates; the controller is rescheduled at the next update.
+    World& touch(size_t i){
+        nodes[i].light.setClock(lightClock - lightOffset[i]);
+        if(!touched[i]){ touched[i] = 1; touchedNodes.push_back(uint32_t(i)); }
+        return nodes[i];
+    }
+
+    void setSpawnInterval(float ns, float ew){
+        for(auto& w : nodes){ w.spawnIntervalNS = ns; w.spawnIntervalEW = ew; }
+    }
+
+    // Cars in the nodes plus those in flight between two of them.
+    size_t vehicleCount() const {
+        size_t n = 0;
+        for(size_t i = 0; i < nodes.size(); i++){
+            n += nodes[i].cars.live();
+            for(int d = 0; d < 4; d++) n += links[i].out[d].size() + links[i].spill[d].size();
+        }
+        return n;
+    }
+
+    long long exited() const {
+        long long n = 0;
+        for(size_t i = 0; i < nodes.size(); i++) n += links[i].left;
+        return n;
+    }
+
+    // One tick in two phases, each a barrier. First every node drains the cars its
+    // neighbors handed it last tick and publishes its lane tails; then every node
+    // steps against its neighbors' published tails and queues its own exits, running
+    // its controller first if the controller was found due.
+    void update(float dt){
+        tick++;
+        if(dt != tickSeconds){ tickSeconds = dt; tickUs = TrafficLightSystem::micros(dt); }
+        lightClock += tickUs;
+        if(!scheduled){
+            for(size_t i = 0; i < nodes.size(); i++) schedule(i);
+            scheduled = true;
+        } else {
+            for(uint32_t i : touchedNodes) schedule(i);
+        }
+        for(uint32_t i : touchedNodes) touched[i] = 0;
+        touchedNodes.clear();
+        while(!timers.empty() && timers.top().at <= lightClock){
+            uint32_t i = timers.top().node;
+            timers.pop();
+            if(!lightDue[i]){ lightDue[i] = 1; dueNodes.push_back(i); }
+        }
+        forEachNode([&](size_t i){ receive(int(i % cols), int(i / cols)); });
+        forEachNode([&](size_t i){ step(int(i % cols), int(i / cols), dt); });
+        for(uint32_t i : dueNodes){ lightDue[i] = 0; schedule(i); }
+        dueNodes.clear();
+    }
+
+private:
+    // A car crossing to a neighbor, stamped with the tick it left on.
+    struct Crossing { Car car; uint64_t tick; };
+
+    // Per-node border state. out[d] carries exits in direction d (N, S, E, W) to that
+    // neighbor: the node is the only producer and the neighbor the only consumer.
+    // Exits that find the ring full wait in spill, owned by the producer.
+    struct Link {
+        SpscRing<Crossing, 8> out[4];
+        std::vector<Crossing> spill[4];
+        bool tail[LaneIndex::kLanes]{};
+        float tailX[LaneIndex::kLanes]{}, tailY[LaneIndex::kLanes]{};
+        long long left=0;
+    };
+    std::unique_ptr<Link[]> links;
+
+    // Controller deadlines in network time, earliest first. A node may also have
+    // entries that are stale or early; popping one only visits the controller, which
+    // does nothing before its real deadline and is then scheduled again. An entry is
+    // never late, since every change to a controller goes through an update or touch().
+    struct Timer {
+        uint64_t at;
+        uint32_t node;
+        bool operator>(const Timer& o) const { return at != o.at ? at > o.at : node > o.node; }
+    };
+    using Timers = std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>>;
+    Timers timers;
+    // Network time is the controller clock every node would have if none had been
+    // paused; lightOffset is how long each node has been paused, in microseconds.
+    uint64_t lightClock = 0;
+    float tickSeconds = 0;
+    uint64_t tickUs = 0;
+    std::vector<uint64_t> lightOffset;
+    std::vector<uint8_t> lightDue, touched;
+    std::vector<uint32_t> dueNodes, touchedNodes;
+    bool scheduled = false;
+
+    void schedule(size_t i){
+        uint64_t d = nodes[i].light.dueAt();
+        if(d != TrafficLightSystem::kNever) timers.push(Timer{d + lightOffset[i], uint32_t(i)});
+    }
+
+    template<class F>
+    void forEachNode(F&& f){
+        if(!pool){ for(size_t i = 0; i < nodes.size(); i++) f(i); return; }
+        size_t grain = std::max<size_t>(1, nodes.size() / (size_t(pool->size()) * 8));
+        pool->parallelFor(0, nodes.size(), grain, [&](size_t b, size_t e){ for(size_t i = b; i < e; i++) f(i); });
+    }
+
+    static int direction(char axis){ return axis=='N' ? 0 : axis=='S' ? 1 : axis=='E' ? 2 : 3; }
+
+    static void downstream(char axis, int& col, int& row){
+        if(axis=='N') row++;
+        else if(axis=='S') row--;
+        else if(axis=='E') col++;
+        else col--;
+    }
+
+    bool inGrid(int col, int row) const { return col >= 0 && col < cols && row >= 0 && row < rows; }
+    Link& linkAt(int col, int row) const { return links[size_t(row) * cols + col]; }
+
+    // Admits what the four feeding neighbors sent before this tick, in the row-major
+    // order of the source node so lane order does not depend on thread timing, then
+    // publishes the tail of every lane for the upstream nodes to read.
+    void receive(int col, int row){
+        World& to = at(col, row);
+        if(row > 0) admit(to, linkAt(col, row - 1).out[0], 0, -kSpanY);
+        if(col > 0) admit(to, linkAt(col - 1, row).out[2], -kSpanX, 0);
+        if(col + 1 < cols) admit(to, linkAt(col + 1, row).out[3], kSpanX, 0);
+        if(row + 1 < rows) admit(to, linkAt(col, row + 1).out[1], 0, kSpanY);
+        Link& self = linkAt(col, row);
+        for(int L = 0; L < LaneIndex::kLanes; L++){
+            const std::vector<uint32_t>& lane = to.lanes.lanes[L];
+            self.tail[L] = !lane.empty();
+            if(lane.empty()) continue;
+            self.tailX[L] = to.cars.x[lane.back()];
+            self.tailY[L] = to.cars.y[lane.back()];
+        }
+    }
+
+    void admit(World& to, SpscRing<Crossing, 8>& in, float sx, float sy){
+        while(const Crossing* c = in.front()){
+            if(c->tick >= tick) break;
+            Car car = c->car;
+            in.pop();
+            car.x += sx; car.y += sy;
+            to.addCar(car);
+        }
+    }
+
+    // Sees the downstream lane tails as ghost leaders, so queues spill back across the
+    // node edge instead of piling into a full neighbor, then steps and sends exits on.
+    void step(int col, int row, float dt){
+        World& w = at(col, row);
+        Link& self = linkAt(col, row);
+        const size_t i = size_t(row) * cols + col;
+        for(int L = 0; L < LaneIndex::kLanes; L++){
+            int nc = col, nr = row;
+            downstream("NSEW"[L / 2], nc, nr);
+            w.ghost[L] = inGrid(nc, nr) && linkAt(nc, nr).tail[L];
+            if(!w.ghost[L]) continue;
+            w.ghostX[L] = linkAt(nc, nr).tailX[L] + (nc - col) * kSpanX;
+            w.ghostY[L] = linkAt(nc, nr).tailY[L] + (nr - row) * kSpanY;
+        }
+        // A paused node's controller stands still, so its deadlines move out with it.
+        if(w.paused) lightOffset[i] += tickUs;
+        else if(lightDue[i]){
+            w.light.demand = w.detectDemand();
+            w.light.tickTo(lightClock - lightOffset[i], tickUs);
+        }
+        w.update(dt, false);
+        for(int d = 0; d < 4; d++){
+            std::vector<Crossing>& spill = self.spill[d];
+            size_t sent = 0;
+            while(sent < spill.size() && self.out[d].push(spill[sent])) sent++;
+            spill.erase(spill.begin(), spill.begin() + sent);
+        }
+        for(const Car& c : w.exits){
+            int nc = col, nr = row;
+            downstream(c.axis, nc, nr);
+            if(!inGrid(nc, nr)){ self.left++; continue; }
+            int d = direction(c.axis);
+            Crossing x{c, tick};
+            if(!self.spill[d].empty() || !self.out[d].push(x)) self.spill[d].push_back(x);
+        }
+        w.exits.clear();
+    }
+};
@@ -0,0 +1,195 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "traffic_control.h"
+#include "traffic_events.h"
+#include "traffic_grid.h"
+#include "traffic_journal.h"
+#include "traffic_telemetry.h"
+
+static void usage(const char* exe){
+    printf("Usage: %s [--seconds S] [--dt DT] [--spawn INTERVAL] [--plan NAME] [--grid COLSxROWS] [--threads N] [--events] [--control PATH] [--realtime] [--telemetry NAME] [--record FILE] [--replay FILE]\n", exe);
+    printf("  --seconds S      simulated seconds to run (default 3600)\n");
+    printf("  --dt DT          fixed simulation step in seconds (default 0.016667)\n");
+    printf("  --spawn I        spawn interval for both axes in seconds (default 2.2)\n");
+    printf("  --plan NAME      signal plan: two-phase (default), four-phase or actuated\n");
+    printf("  --grid CxR       run a COLS x ROWS grid of intersections instead of one\n");
+    printf("  --threads N      step grid intersections on N threads (default 1)\n");
+    printf("  --events         run one intersection on the discrete-event engine instead of ticks\n");
+    printf("  --control PATH   accept commands on a UNIX socket at PATH between ticks (one intersection)\n");
+    printf("  --realtime       pace ticks to the wall clock instead of running flat out\n");
+    printf("  --telemetry NAME publish every tick to the shared-memory ring NAME, e.g. /traffic (one intersection)\n");
+    printf("  --record FILE    journal commands and spawns to FILE for --replay (one intersection)\n");
+    printf("  --replay FILE    rerun a journal flat out and check it reproduces the recorded run;\n");
+    printf("                   takes no other options\n");
+}
+
+// Discrete-event run of a single intersection: the clock jumps from event to event.
+static int runEvents(double seconds, float spawn, int plan){
+    World world;
+    world.spawnIntervalNS = spawn;
+    world.spawnIntervalEW = spawn;
+    world.light.setPlan(*kSignalPlans[plan].plan);
+    auto start = std::chrono::steady_clock::now();
+    EventEngine engine(world);
+    engine.advanceTo(seconds);
+    auto end = std::chrono::steady_clock::now();
+    double wall = std::chrono::duration<double>(end - start).count();
+    size_t live = world.cars.live();
+
+    printf("events:       %lld\n", engine.events);
+    printf("simulated:    %.3f s\n", seconds);
+    printf("wall:         %.6f s\n", wall);
+    printf("throughput:   %.1f sim-s/wall-s\n", wall > 0 ? seconds / wall : 0.0);
+    printf("event rate:   %.1f events/s\n", wall > 0 ? engine.events / wall : 0.0);
+    printf("cars:         %zu live, %lld left the intersection\n", live, engine.exited);
+    return 0;
+}
+
+// Reruns a journal at full speed from the parameters it was recorded with, applying
+// each command at its tick and checking every tick's spawns and the final digest.
+static int runReplay(const char* path){
+    JournalReader journal;
+    if(!journal.open(path)) return 1;
+    World world;
+    world.spawnIntervalNS = journal.spawnNS;
+    world.spawnIntervalEW = journal.spawnEW;
+    world.light.setPlan(*kSignalPlans[journal.plan].plan);
+    uint64_t tick = 0, commands = 0, spawns = 0;
+    long long diverged = -1;
+    bool ended = false, digestOk = false;
+    auto start = std::chrono::steady_clock::now();
+    JournalRecord r;
+    bool more = journal.next(r);
+    while(more && diverged < 0){
+        // Every record up to and including this tick's, then the tick itself.
+        while(more && r.kind == 'C' && r.tick == tick){
+            applyCommand(world, r.command);
+            commands++;
+            more = journal.next(r);
+        }
+        if(more && r.kind == 'E' && r.tick == tick){
+            ended = true;
+            digestOk = worldDigest(world) == r.digest;
+            break;
+        }
+        if(!more) break;
+        world.update(journal.dt);
+        uint8_t want = 0;
+        if(r.kind == 'S' && r.tick == tick){
+            want = r.spawned;
+            spawns++;
+            more = journal.next(r);
+        }
+        if(world.spawned != want || (more && r.tick <= tick)) diverged = (long long)tick;
+        tick++;
+    }
+    auto end = std::chrono::steady_clock::now();
+    double wall = std::chrono::duration<double>(end - start).count();
+    double simulated = double(tick) * journal.dt;
+
+    printf("ticks:        %llu\n", (unsigned long long)tick);
+    printf("simulated:    %.3f s\n", simulated);
+    printf("wall:         %.6f s\n", wall);
+    printf("throughput:   %.1f sim-s/wall-s\n", wall > 0 ? simulated / wall : 0.0);
+    printf("journal:      %llu commands, %llu spawn ticks\n", (unsigned long long)commands, (unsigned long long)spawns);
+    if(diverged >= 0){ printf("replay:       DIVERGED at tick %lld\n", diverged); return 1; }
+    if(journal.corrupt){ printf("replay:       journal CORRUPT at byte %zu, after tick %llu\n", journal.errorAt, (unsigned long long)tick); return 1; }
+    if(journal.truncated) printf("replay:       journal cut off after tick %llu; matched up to there\n", (unsigned long long)tick);
+    else if(!ended) printf("replay:       no end record; matched up to tick %llu\n", (unsigned long long)tick);
+    else if(!digestOk){ printf("replay:       final state DIFFERS\n"); return 1; }
+    else printf("replay:       identical\n");
+    return 0;
+}
+
+int main(int argc, char** argv){
+    double seconds = 3600.0;
+    float dt = 1.0f / 60.0f;
+    float spawn = 2.2f;
+    int plan = 0;
+    int cols = 0, rows = 0;
+    int threads = 1;
+    bool events = false;
+    const char* control = nullptr;
+    bool realtime = false;
+    const char* telemetryName = nullptr;
+    const char* record = nullptr;
+    const char* replay = nullptr;
+    for(int i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "--seconds") && i+1 < argc) seconds = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--dt") && i+1 < argc) dt = float(atof(argv[++i]));
+        else if(!strcmp(argv[i], "--spawn") && i+1 < argc) spawn = float(atof(argv[++i]));
+        else if(!strcmp(argv[i], "--plan") && i+1 < argc){
+            if((plan = signalPlanIndex(argv[++i])) < 0){ usage(argv[0]); return 1; }
+        }
+        else if(!strcmp(argv[i], "--grid") && i+1 < argc){
+            if(sscanf(argv[++i], "%dx%d", &cols, &rows) != 2 || cols < 1 || rows < 1){ usage(argv[0]); return 1; }
+        }
+        else if(!strcmp(argv[i], "--threads") && i+1 < argc) threads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--events")) events = true;
+        else if(!strcmp(argv[i], "--control") && i+1 < argc) control = argv[++i];
+        else if(!strcmp(argv[i], "--realtime")) realtime = true;
+        else if(!strcmp(argv[i], "--telemetry") && i+1 < argc) telemetryName = argv[++i];
+        else if(!strcmp(argv[i], "--record") && i+1 < argc) record = argv[++i];
+        else if(!strcmp(argv[i], "--replay") && i+1 < argc) replay = argv[++i];
+        else { usage(argv[0]); return strcmp(argv[i], "--help") ? 1 : 0; }
+    }
+    if(dt <= 0.f || seconds <= 0.0 || threads < 1 || (events && cols > 0) || ((control || telemetryName || record) && (events || cols > 0))){ usage(argv[0]); return 1; }
+    // A replay takes everything from the journal.
+    if(replay){
+        if(argc != 3){ usage(argv[0]); return 1; }
+        return runReplay(replay);
+    }
+    if(events) return runEvents(seconds, spawn, plan);
+
+    // A single intersection is a 1x1 grid without hand-off.
+    Network net;
+    net.build(std::max(cols, 1), std::max(rows, 1));
+    net.setSpawnInterval(spawn, spawn);
+    for(World& w : net.nodes) w.light.setPlan(*kSignalPlans[plan].plan);
+    if(cols == 0) net.nodes[0].handoff = false;
+    std::unique_ptr<ThreadPool> pool;
+    if(threads > 1){ pool.reset(new ThreadPool(unsigned(threads))); net.pool = pool.get(); }
+
+    ControlServer server;
+    if(control && !server.open(control)) return 1;
+    TelemetryWriter telemetry;
+    if(telemetryName && !telemetry.open(telemetryName)) return 1;
+    JournalWriter journal;
+    if(record && !journal.open(record, dt, spawn, spawn, uint8_t(plan))) return 1;
+
+    long long ticks = (long long)std::ceil(seconds / dt);
+    size_t peakCars = 0;
+    uint32_t timeouts = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(long long t = 0; t < ticks; t++){
+        if(realtime) std::this_thread::sleep_until(start + std::chrono::duration<double>(double(t) * dt));
+        if(control) server.poll(net.touch(0), uint64_t(t), [&](const Command& c){ journal.command(uint64_t(t), c); });
+        net.update(dt);
+        if(control && net.nodes[0].light.emergencyTimeouts != timeouts){
+            timeouts = net.nodes[0].light.emergencyTimeouts;
+            printf("Emergency mode auto-cleared after 30 seconds\n");
+        }
+        journal.ticked(uint64_t(t), net.nodes[0]);
+        if(telemetryName) telemetry.publish(net.touch(0), uint64_t(t + 1), double(t + 1) * dt);
+        peakCars = std::max(peakCars, net.vehicleCount());
+    }
+    auto end = std::chrono::steady_clock::now();
+    double wall = std::chrono::duration<double>(end - start).count();
+    double simulated = double(ticks) * dt;
+    if(record && !journal.close(uint64_t(ticks), net.touch(0))){ fprintf(stderr, "journal: write to %s failed\n", record); return 1; }
+
+    printf("ticks:        %lld\n", ticks);
+    printf("simulated:    %.3f s\n", simulated);
+    printf("wall:         %.6f s\n", wall);
+    printf("throughput:   %.1f sim-s/wall-s\n", wall > 0 ? simulated / wall : 0.0);
+    printf("tick rate:    %.1f ticks/s\n", wall > 0 ? ticks / wall : 0.0);
+    printf("intersections:%zu (%dx%d) on %d thread(s)\n", net.nodes.size(), net.cols, net.rows, threads);
+    if(cols > 0) printf("cars:         %zu live, %zu peak, %lld left the grid\n", net.vehicleCount(), peakCars, net.exited());
+    else printf("cars:         %zu live, %zu peak, %lld left the intersection\n", net.vehicleCount(), peakCars, net.nodes[0].exited);
+    if(control) printf("control:      %llu commands in %llu batches\n", (unsigned long long)server.commands, (unsigned long long)server.batches);
+    return 0;
+}
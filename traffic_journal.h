@@ -0,0 +1,228 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "traffic_commands.h"
+
+// Binary journal of one intersection's run, for replaying an incident. It records
+// every operator command with the tick it was applied before, which approaches spawned
+// a car on each tick, and on a clean close the tick count with a digest of the final
+// state. Given the same starting parameters the simulation is a pure function of the
+// commands, so a replay applies them at their ticks and checks its own spawns and final
+// digest against the journal, which catches the first tick where a run diverged.
+//
+// File: "TJNL", u16 version, f32 dt, f32 spawn interval NS and EW, u8 signal plan (an
+// index into kSignalPlans), then records starting with a kind byte and the varint
+// tick distance from the previous record:
+//   'C' command   u8 type, head, value, flags; f32 delta for AdjustSpawn only
+//   'S' spawns    u8 approach mask (bit 0..3 = N, S, E, W); ticks with none are skipped
+//   'E' end       u64 digest; the tick is the number of ticks run
+// Numbers are little-endian.
+
+const uint16_t kJournalVersion = 2;
+
+// FNV-1a over what a replay has to reproduce exactly: every live car, the lights and
+// the controller and spawn timers.
+inline uint64_t worldDigest(const World& w){
+    uint64_t h = 1469598103934665603ull;
+    auto mix = [&](const void* p, size_t n){
+        const uint8_t* b = static_cast<const uint8_t*>(p);
+        for(size_t i = 0; i < n; i++){ h ^= b[i]; h *= 1099511628211ull; }
+    };
+    const VehicleStore& c = w.cars;
+    for(size_t i = 0; i < c.size(); i++){
+        if(!c.active[i]) continue;
+        mix(&c.x[i], 4); mix(&c.y[i], 4); mix(&c.axis[i], 1); mix(&c.lane[i], 1);
+    }
+    const uint8_t lights[4] = { uint8_t(w.light.north.state), uint8_t(w.light.south.state),
+                                uint8_t(w.light.east.state), uint8_t(w.light.west.state) };
+    const float timers[5] = { w.light.nextChangeIn(), w.spawnTimerNS, w.spawnTimerEW, w.spawnIntervalNS, w.spawnIntervalEW };
+    mix(lights, sizeof(lights));
+    mix(timers, sizeof(timers));
+    const uint8_t modes[3] = { w.light.manual, w.light.emergencyMode, w.paused };
+    mix(modes, sizeof(modes));
+    return h;
+}
+
+struct JournalRecord {
+    char kind = 0;
+    uint64_t tick = 0;
+    Command command;     // 'C'
+    uint8_t spawned = 0; // 'S'
+    uint64_t digest = 0; // 'E'
+};
+
+class JournalWriter {
+public:
+    // Without close() the records so far are kept, but there is no end record.
+    ~JournalWriter(){
+        if(!file) return;
+        fwrite(buf.data(), 1, buf.size(), file);
+        fclose(file);
+    }
+
+    bool open(const char* path, float dt, float spawnNS, float spawnEW, uint8_t plan){
+        file = fopen(path, "wb");
+        if(!file){ perror("journal"); return false; }
+        buf.reserve(kFlushBytes + 64);
+        buf.insert(buf.end(), { 'T', 'J', 'N', 'L' });
+        put(kJournalVersion, 2);
+        putFloat(dt); putFloat(spawnNS); putFloat(spawnEW);
+        buf.push_back(plan);
+        return true;
+    }
+
+    bool isOpen() const { return file != nullptr; }
+
+    // c was applied (or dropped as manual-only) ahead of tick.
+    void command(uint64_t tick, const Command& c){
+        if(!file) return;
+        record('C', tick);
+        buf.push_back(uint8_t(c.type)); buf.push_back(c.head); buf.push_back(c.value); buf.push_back(c.flags);
+        if(c.type == CommandType::AdjustSpawn) putFloat(c.delta);
+        flushIfFull();
+    }
+
+    // After update number tick of w.
+    void ticked(uint64_t tick, const World& w){
+        if(!file || !w.spawned) return;
+        record('S', tick);
+        buf.push_back(w.spawned);
+        flushIfFull();
+    }
+
+    // Writes the end record after ticks updates and closes the file.
+    bool close(uint64_t ticks, const World& w){
+        if(!file) return false;
+        record('E', ticks);
+        put(worldDigest(w), 8);
+        bool ok = fwrite(buf.data(), 1, buf.size(), file) == buf.size();
+        ok = fclose(file) == 0 && ok;
+        file = nullptr;
+        buf.clear();
+        return ok;
+    }
+
+private:
+    static const size_t kFlushBytes = 1 << 16;
+    FILE* file = nullptr;
+    std::vector<uint8_t> buf;
+    uint64_t last = 0;
+
+    void put(uint64_t v, int bytes){ for(int i = 0; i < bytes; i++) buf.push_back(uint8_t(v >> (8 * i))); }
+    void putFloat(float f){ uint32_t u; memcpy(&u, &f, 4); put(u, 4); }
+
+    void record(char kind, uint64_t tick){
+        buf.push_back(uint8_t(kind));
+        for(uint64_t d = tick - last; ; d >>= 7){
+            if(d < 0x80){ buf.push_back(uint8_t(d)); break; }
+            buf.push_back(uint8_t(d | 0x80));
+        }
+        last = tick;
+    }
+
+    void flushIfFull(){
+        if(buf.size() < kFlushBytes) return;
+        fwrite(buf.data(), 1, buf.size(), file);
+        buf.clear();
+    }
+};
+
+class JournalReader {
+public:
+    float dt = 0, spawnNS = 0, spawnEW = 0;
+    int plan = 0;
+    bool truncated = false; // reading stopped at a record cut off by the end of the file
+    bool corrupt = false;   // reading stopped at a malformed record, which starts at errorAt
+    size_t errorAt = 0;
+
+    // Reads the whole file; false if it is missing, not a journal or its parameters
+    // are out of range.
+    bool open(const char* path){
+        FILE* f = fopen(path, "rb");
+        if(!f){ perror("journal"); return false; }
+        data.clear();
+        uint8_t chunk[1 << 16];
+        for(size_t n; (n = fread(chunk, 1, sizeof(chunk), f)) > 0;) data.insert(data.end(), chunk, chunk + n);
+        fclose(f);
+        pos = 0; last = 0;
+        truncated = corrupt = false;
+        errorAt = 0;
+        if(data.size() < 19 || memcmp(data.data(), "TJNL", 4)){ fprintf(stderr, "journal: %s is not a journal\n", path); return false; }
+        pos = 4;
+        if(get(2) != kJournalVersion){ fprintf(stderr, "journal: unsupported version\n"); return false; }
+        dt = getFloat(); spawnNS = getFloat(); spawnEW = getFloat();
+        plan = data[pos++];
+        if(!positive(dt) || !positive(spawnNS) || !positive(spawnEW)){
+            fprintf(stderr, "journal: bad tick length or spawn interval\n");
+            return false;
+        }
+        if(plan >= kSignalPlanCount){ fprintf(stderr, "journal: unknown signal plan %d\n", plan); return false; }
+        return true;
+    }
+
+    // The next record, or false at the end of the file or at a record that is cut off
+    // (truncated) or malformed (corrupt).
+    bool next(JournalRecord& r){
+        if(pos >= data.size()) return false;
+        size_t start = pos;
+        r = JournalRecord();
+        r.kind = char(data[pos++]);
+        uint64_t d = 0;
+        for(int shift = 0; ; shift += 7){
+            if(shift > 63) return malformed(start);
+            if(pos >= data.size()) return cutOff(start);
+            uint8_t b = data[pos++];
+            d |= uint64_t(b & 0x7f) << shift;
+            if(!(b & 0x80)) break;
+        }
+        r.tick = last + d;
+        if(r.kind == 'C'){
+            if(pos + 4 > data.size()) return cutOff(start);
+            r.command.type = CommandType(data[pos]); r.command.head = data[pos+1];
+            r.command.value = data[pos+2]; r.command.flags = data[pos+3];
+            pos += 4;
+            if(r.command.type == CommandType::AdjustSpawn){
+                if(pos + 4 > data.size()) return cutOff(start);
+                r.command.delta = getFloat();
+            }
+            if(!validCommand(r.command)) return malformed(start);
+            r.command.tick = r.tick;
+        } else if(r.kind == 'S'){
+            if(pos + 1 > data.size()) return cutOff(start);
+            r.spawned = data[pos++];
+            if(r.spawned > 15) return malformed(start);
+        } else if(r.kind == 'E'){
+            if(pos + 8 > data.size()) return cutOff(start);
+            r.digest = get(8);
+        } else {
+            return malformed(start);
+        }
+        last = r.tick;
+        return true;
+    }
+
+private:
+    std::vector<uint8_t> data;
+    size_t pos = 0;
+    uint64_t last = 0;
+
+    static bool positive(float f){ return std::isfinite(f) && f > 0; }
+    // Fields in the ranges the command sources produce; head and switch values outside
+    // them would otherwise be mapped to some head or state by applyCommand.
+    static bool validCommand(const Command& c){
+        if(uint8_t(c.type) > uint8_t(CommandType::Pause) || c.head > 3 || c.value > 2) return false;
+        if(c.flags & ~kCommandManualOnly) return false;
+        return c.type != CommandType::AdjustSpawn || std::isfinite(c.delta);
+    }
+    bool cutOff(size_t start){ pos = data.size(); truncated = true; errorAt = start; return false; }
+    bool malformed(size_t start){ pos = data.size(); corrupt = true; errorAt = start; return false; }
+    uint64_t get(int bytes){
+        uint64_t v = 0;
+        for(int i = 0; i < bytes; i++) v |= uint64_t(data[pos++]) << (8 * i);
+        return v;
+    }
+    float getFloat(){ uint32_t u = uint32_t(get(4)); float f; memcpy(&f, &u, 4); return f; }
+};
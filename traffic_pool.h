@@ -0,0 +1,95 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Thread pool for data-parallel loops. parallelFor cuts an index range into chunks of
+// grain indices which the threads claim in order from one shared cursor, so handing
+// out a chunk is a single atomic add and no lock is taken per chunk. The loops it runs
+// are over grid nodes of about equal cost, which balance without stealing. The calling
+// thread takes part and then sleeps until the last chunk is done, so each call is a
+// barrier. Calls must not be nested or made concurrently.
+class ThreadPool {
+public:
+    using RangeFn = std::function<void(size_t, size_t)>;
+
+    explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency()){
+        if(threads == 0) threads = 1;
+        for(unsigned i = 1; i < threads; i++) workers.emplace_back([this]{ workerLoop(); });
+    }
+
+    ~ThreadPool(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for(auto& t : workers) t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return unsigned(workers.size()) + 1; }
+
+    // Calls fn(b, e) over disjoint sub-ranges covering [begin, end), at most grain wide.
+    void parallelFor(size_t begin, size_t end, size_t grain, const RangeFn& fn){
+        if(begin >= end) return;
+        if(grain == 0) grain = 1;
+        if(workers.empty() || end - begin <= grain){ fn(begin, end); return; }
+        Job j{&fn, end, grain};
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            // A worker that woke too late for the previous call may still hold its job.
+            idle.wait(lock, [&]{ return busy == 0; });
+            job = j;
+            cursor.store(begin, std::memory_order_relaxed);
+            generation++;
+        }
+        wake.notify_all();
+        run(j);
+        // The cursor is past the end now, so every chunk is done or held by a busy worker.
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [&]{ return busy == 0; });
+    }
+
+private:
+    struct Job { const RangeFn* fn = nullptr; size_t end = 0, grain = 1; };
+
+    std::vector<std::thread> workers;
+    alignas(64) std::atomic<size_t> cursor{0};
+    alignas(64) std::mutex mutex;
+    std::condition_variable wake, idle;
+    Job job;
+    unsigned long long generation = 0;
+    unsigned busy = 0;
+    bool stopping = false;
+
+    void run(const Job& j){
+        for(size_t b; (b = cursor.fetch_add(j.grain, std::memory_order_relaxed)) < j.end;)
+            (*j.fn)(b, std::min(b + j.grain, j.end));
+    }
+
+    void workerLoop(){
+        unsigned long long seen = 0;
+        for(;;){
+            Job j;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]{ return stopping || generation != seen; });
+                if(stopping) return;
+                seen = generation;
+                j = job;
+                busy++;
+            }
+            run(j);
+            std::lock_guard<std::mutex> lock(mutex);
+            if(--busy == 0) idle.notify_all();
+        }
+    }
+};
@@ -0,0 +1,116 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Signal programs. A program is a list of phases; each phase gives green to a set of
+// movements, then clears them through yellow and an all-red interval. Programs are
+// compiled once into a flat table of steps, each holding the packed state of all four
+// heads, so the controller advances with a table lookup and never branches on direction.
+
+// One bit per approach; the bit index is also the head index (N, S, E, W).
+enum Movement : uint8_t { MOVE_N = 1, MOVE_S = 2, MOVE_E = 4, MOVE_W = 8 };
+
+// Green runs minGreen seconds and, while demand is detected on one of its movements,
+// is extended by passage seconds at a time up to maxGreen.
+struct SignalPhase {
+    uint8_t movements;
+    float minGreen, maxGreen, yellow, allRed;
+};
+
+// heads packs one LightState per head, two bits each, head i at bits 2i..2i+1.
+struct SignalStep {
+    uint32_t minUs, maxUs;
+    uint8_t heads, movements;
+    uint16_t next;
+};
+
+// A compiled program. It holds its steps; controllers running it only point at it.
+struct SignalPlan {
+    static const size_t kMaxPhases = 8;
+    SignalStep steps[3 * kMaxPhases] = {};
+    uint16_t count = 0;
+    uint32_t passageUs = 2000000;
+};
+
+constexpr uint32_t signalMicros(float seconds){ return uint32_t(double(seconds) * 1e6 + 0.5); }
+
+// Writes the steps of n phases to out and returns how many were written (at most 3n).
+// Zero-length yellow and all-red steps are dropped. A green step lasts at least 1 us,
+// so the controller always moves on to a later time and even a program of zero-length
+// greens advances one step per tick instead of spinning at one instant.
+constexpr size_t compileSignalSteps(const SignalPhase* phases, size_t n, SignalStep* out){
+    // Packed head states for RED = 0, YELLOW = 1, GREEN = 2; see LightState.
+    size_t count = 0;
+    for(size_t p = 0; p < n; p++){
+        const SignalPhase& ph = phases[p];
+        uint8_t green = 0, yellow = 0;
+        for(int h = 0; h < 4; h++){
+            if(ph.movements >> h & 1){ green |= uint8_t(2 << (2*h)); yellow |= uint8_t(1 << (2*h)); }
+        }
+        uint32_t minGreen = ph.minGreen > 0 ? signalMicros(ph.minGreen) : 0;
+        if(minGreen < 1) minGreen = 1;
+        uint32_t maxGreen = ph.maxGreen > ph.minGreen ? signalMicros(ph.maxGreen) : minGreen;
+        out[count++] = SignalStep{minGreen, maxGreen, green, ph.movements, 0};
+        if(ph.yellow > 0) out[count++] = SignalStep{signalMicros(ph.yellow), signalMicros(ph.yellow), yellow, 0, 0};
+        if(ph.allRed > 0) out[count++] = SignalStep{signalMicros(ph.allRed), signalMicros(ph.allRed), 0, 0, 0};
+    }
+    for(size_t i = 0; i < count; i++) out[i].next = uint16_t(i + 1 < count ? i + 1 : 0);
+    return count;
+}
+
+template<size_t N>
+constexpr SignalPlan compileSignalProgram(const SignalPhase (&phases)[N]){
+    static_assert(N > 0 && N <= SignalPlan::kMaxPhases, "a signal program has 1 to kMaxPhases phases");
+    SignalPlan plan;
+    plan.count = uint16_t(compileSignalSteps(phases, N, plan.steps));
+    return plan;
+}
+
+// For programs loaded at run time. False, leaving out alone, if there are no phases
+// or more than SignalPlan::kMaxPhases.
+inline bool compileSignalProgram(const std::vector<SignalPhase>& phases, SignalPlan& out){
+    if(phases.empty() || phases.size() > SignalPlan::kMaxPhases) return false;
+    SignalPlan plan;
+    plan.count = uint16_t(compileSignalSteps(phases.data(), phases.size(), plan.steps));
+    out = plan;
+    return true;
+}
+
+// Stock programs. Two-phase alternates E/W and N/S; four-phase serves each approach
+// alone; the actuated two-phase holds green between 5 and 20 s depending on demand.
+constexpr SignalPhase kTwoPhaseProgram[] = {
+    {MOVE_E | MOVE_W, 10.0f, 10.0f, 2.0f, 1.0f},
+    {MOVE_N | MOVE_S, 10.0f, 10.0f, 2.0f, 1.0f},
+};
+constexpr SignalPhase kFourPhaseProgram[] = {
+    {MOVE_E, 8.0f, 8.0f, 2.0f, 1.0f},
+    {MOVE_W, 8.0f, 8.0f, 2.0f, 1.0f},
+    {MOVE_N, 8.0f, 8.0f, 2.0f, 1.0f},
+    {MOVE_S, 8.0f, 8.0f, 2.0f, 1.0f},
+};
+constexpr SignalPhase kActuatedTwoPhaseProgram[] = {
+    {MOVE_E | MOVE_W, 5.0f, 20.0f, 2.0f, 1.0f},
+    {MOVE_N | MOVE_S, 5.0f, 20.0f, 2.0f, 1.0f},
+};
+inline constexpr SignalPlan kTwoPhasePlan = compileSignalProgram(kTwoPhaseProgram);
+inline constexpr SignalPlan kFourPhasePlan = compileSignalProgram(kFourPhaseProgram);
+inline constexpr SignalPlan kActuatedTwoPhasePlan = compileSignalProgram(kActuatedTwoPhaseProgram);
+
+// Stock plans by the name the command-line --plan options take; the index is what a
+// journal records.
+struct NamedSignalPlan { const char* name; const SignalPlan* plan; };
+inline constexpr NamedSignalPlan kSignalPlans[] = {
+    { "two-phase", &kTwoPhasePlan },
+    { "four-phase", &kFourPhasePlan },
+    { "actuated", &kActuatedTwoPhasePlan },
+};
+const int kSignalPlanCount = int(sizeof(kSignalPlans) / sizeof(kSignalPlans[0]));
+
+// Index into kSignalPlans, or -1 if no stock plan has that name.
+inline int signalPlanIndex(const char* name){
+    for(int i = 0; i < kSignalPlanCount; i++)
+        if(!strcmp(kSignalPlans[i].name, name)) return i;
+    return -1;
+}
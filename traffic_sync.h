@@ -0,0 +1,112 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Bounded single-producer/single-consumer ring. push is only called from the producer
+// thread and front/pop only from the consumer thread; neither side takes a lock, and
+// head and tail sit on separate cache lines so the two sides do not share a line.
+template<class T, size_t Capacity>
+class SpscRing {
+    static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+public:
+    bool push(const T& v){
+        size_t t = tail.load(std::memory_order_relaxed);
+        if(t - head.load(std::memory_order_acquire) == Capacity) return false;
+        buf[t & (Capacity - 1)] = v;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Oldest entry, or nullptr when empty. Valid until the matching pop().
+    const T* front() const {
+        size_t h = head.load(std::memory_order_relaxed);
+        if(h == tail.load(std::memory_order_acquire)) return nullptr;
+        return &buf[h & (Capacity - 1)];
+    }
+
+    void pop(){ head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+
+private:
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) T buf[Capacity];
+};
+
+// Lock-free triple buffer for one writer and one reader. The writer fills back() and
+// publishes it; the reader calls refresh() to take the newest published slot and reads
+// it through front(). Neither side ever waits: the writer always has a slot of its own,
+// and the reader keeps its slot until it refreshes, so a slow reader only skips states.
+template<class T>
+class TripleBuffer {
+public:
+    T& back(){ return slots[backIndex]; }
+
+    void publish(){
+        backIndex = state.exchange(backIndex | kFresh, std::memory_order_acq_rel) & kIndex;
+    }
+
+    // Takes the newest published slot; false if nothing was published since last time.
+    bool refresh(){
+        if(!(state.load(std::memory_order_relaxed) & kFresh)) return false;
+        frontIndex = state.exchange(frontIndex, std::memory_order_acq_rel) & kIndex;
+        return true;
+    }
+
+    const T& front() const { return slots[frontIndex]; }
+
+private:
+    static const unsigned kIndex = 3, kFresh = 4;
+    T slots[3];
+    // Index of the slot between the two sides, plus kFresh once the writer published it.
+    alignas(64) std::atomic<unsigned> state{1};
+    alignas(64) unsigned backIndex = 0;
+    alignas(64) unsigned frontIndex = 2;
+};
+
+// Bounded multi-producer/single-consumer queue. Any thread may push; only the consumer
+// thread pops. Each cell carries a sequence number that says whose turn it is, so a
+// producer claims a cell with one compare-exchange on tail and publishes it with one
+// release store, and the consumer never touches a shared counter.
+template<class T, size_t Capacity>
+class MpscQueue {
+    static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+public:
+    MpscQueue(){ for(size_t i = 0; i < Capacity; i++) cells[i].seq.store(i, std::memory_order_relaxed); }
+
+    // False if the queue is full.
+    bool push(const T& v){
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for(;;){
+            Cell& c = cells[pos & (Capacity - 1)];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            if(seq == pos){
+                if(tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    c.value = v;
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(seq < pos){
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(T& out){
+        Cell& c = cells[head & (Capacity - 1)];
+        if(c.seq.load(std::memory_order_acquire) != head + 1) return false;
+        out = c.value;
+        c.seq.store(head + Capacity, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+private:
+    struct Cell { std::atomic<size_t> seq; T value; };
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) size_t head = 0;
+    alignas(64) Cell cells[Capacity];
+};
@@ -3,33 +3,79 @@
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstddef>
+#include <cstring>
 #include <vector>
 #include <string>
 #include <algorithm>
 #include <array>
 #include <chrono>
-#include <random>
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
+#include <atomic>
+#include <thread>
+#include "traffic_commands.h"
+#include "traffic_journal.h"
+#include "traffic_telemetry.h"
 
 static const char* kVS = R"GLSL(
 #version 330 core
 layout (location = 0) in vec2 aPos;
-uniform vec2 uPos;      
-uniform vec2 uScale;    
-uniform mat4 uProj;     
+layout (location = 1) in vec2 iPos;
+layout (location = 2) in vec2 iScale;
+layout (location = 3) in vec3 iColor;
+layout (location = 4) in float iShape;
+uniform mat4 uProj;
+out vec3 vColor;
+out vec2 vLocal;
+flat out float vShape;
 void main(){
-    vec2 p = uPos + aPos * uScale; 
+    vec2 p = iPos + aPos * iScale;
+    vColor = iColor;
+    vLocal = aPos;
+    vShape = iShape;
     gl_Position = uProj * vec4(p, 0.0, 1.0);
 }
 )GLSL";
 
 static const char* kFS = R"GLSL(
 #version 330 core
+in vec3 vColor;
+in vec2 vLocal;
+flat in float vShape;
 out vec4 FragColor;
-uniform vec3 uColor;
-void main(){ FragColor = vec4(uColor, 1.0); }
+void main(){
+    float alpha = 1.0;
+    if(vShape > 0.5){
+        // Circle: signed distance to the unit circle, one pixel of coverage ramp.
+        float d = length(vLocal) - 1.0;
+        float aa = fwidth(d);
+        alpha = 1.0 - smoothstep(-aa, aa, d);
+        if(alpha <= 0.0) discard;
+    }
+    FragColor = vec4(vColor, alpha);
+}
+)GLSL";
+
+static const char* kCarVS = R"GLSL(
+#version 330 core
+layout (location = 0) in vec2 iPos;
+layout (location = 1) in float iTemplate;
+layout (location = 2) in vec3 iColor;
+uniform mat4 uProj;
+uniform samplerBuffer uMesh;
+uniform int uVertsPerCar;
+out vec3 vColor;
+out vec2 vLocal;
+flat out float vShape;
+void main(){
+    int base = (int(iTemplate) * uVertsPerCar + gl_VertexID) * 2;
+    vec4 a = texelFetch(uMesh, base);
+    vec4 b = texelFetch(uMesh, base + 1);
+    int flags = int(b.w);
+    vColor = (flags & 1) != 0 ? iColor + b.rgb : b.rgb;
+    vShape = float(flags >> 1);
+    vLocal = a.zw;
+    gl_Position = uProj * vec4(iPos + a.xy, 0.0, 1.0);
+}
 )GLSL";
 
 static GLuint makeShader(GLenum type, const char* src){
@@ -41,9 +87,9 @@ static GLuint makeShader(GLenum type, const char* src){
     return s;
 }
 
-static GLuint makeProgram(){
-    GLuint vs = makeShader(GL_VERTEX_SHADER, kVS);
-    GLuint fs = makeShader(GL_FRAGMENT_SHADER, kFS);
+static GLuint makeProgram(const char* vsSrc, const char* fsSrc){
+    GLuint vs = makeShader(GL_VERTEX_SHADER, vsSrc);
+    GLuint fs = makeShader(GL_FRAGMENT_SHADER, fsSrc);
     GLuint p = glCreateProgram();
     glAttachShader(p, vs); glAttachShader(p, fs);
     glLinkProgram(p);
@@ -69,162 +115,266 @@ public:
     }
 };
 
-enum class LightState { RED, YELLOW, GREEN };
+enum Shape { SHAPE_RECT = 0, SHAPE_CIRCLE = 1 };
 
-class IndividualLight {
-public:
-    LightState state = LightState::RED;
-    float timer = 0.0f;
-    float greenTime = 7.0f;
-    float yellowTime = 2.0f;
-    bool manual = false;
-    
-    void setState(LightState s) { state = s; timer = 0.0f; }
-    
-    void update(float dt) {
-        if(manual) return;
-        timer += dt;
-        if(state == LightState::GREEN && timer >= greenTime) {
-            state = LightState::YELLOW;
-            timer = 0.0f;
-        } else if(state == LightState::YELLOW && timer >= yellowTime) {
-            state = LightState::RED;
-            timer = 0.0f;
-        }
-    }
+struct ShapeInstance { float x, y, hw, hh, r, g, b, shape; };
+
+// Draw order is layer order; inside a layer instances keep submission order.
+enum Layer { LAYER_ROAD, LAYER_SIGNALS, LAYER_VEHICLES, LAYER_HUD, LAYER_COUNT };
+
+struct ShapeLayer {
+    GLuint vao=0, vbo=0;
+    size_t capacity=0;
+    bool dirty=false;
+    bool persistent=false;
+    std::vector<ShapeInstance> items;
 };
 
-class TrafficLightSystem {
-public:
-    IndividualLight north, south, east, west;
-    bool manual = false;
-    bool emergencyMode = false;
-    float emergencyTimer = 0.0f;
-    
-    void setManual(bool on) { 
-        manual = on; 
-        north.manual = on; 
-        south.manual = on; 
-        east.manual = on; 
-        west.manual = on; 
+// Everything the static road geometry depends on.
+struct RoadKey {
+    float l=0, r=0, b=0, t=0, stopNS=0, stopEW=0, roadHalf=0;
+    bool operator==(const RoadKey& o) const {
+        return l==o.l && r==o.r && b==o.b && t==o.t && stopNS==o.stopNS && stopEW==o.stopEW && roadHalf==o.roadHalf;
     }
-    
-    void setEmergencyMode(bool on) {
-        emergencyMode = on;
-        emergencyTimer = 0.0f;
+};
+
+// stateChanges counts binds, enables and uniform sets; uploads counts buffer writes.
+struct RenderStats {
+    int drawCalls=0;
+    int instances=0;
+    int stateChanges=0;
+    int uploads=0;
+    double submitMs=0;
+};
+
+struct CarPart { ShapeInstance s; bool tint; };
+
+// Car layout relative to its center. Tinted parts add their color to the body color.
+// Every car is kCarParts parts; CarMesh sizes its per-car vertex block from it.
+static const int kCarParts = 13;
+static void carParts(std::vector<CarPart>& out, float hw, float hh, char direction, int lane){
+    auto rect = [&](float x, float y, float w, float h, float r, float g, float b, bool tint){
+        out.push_back({{x, y, w, h, r, g, b, float(SHAPE_RECT)}, tint}); };
+    auto circle = [&](float x, float y, float radius, float r, float g, float b){
+        out.push_back({{x, y, radius, radius, r, g, b, float(SHAPE_CIRCLE)}, false}); };
+    bool isVertical = (direction == 'N' || direction == 'S');
+    rect(0, 0, hw, hh, 0, 0, 0, true);
+    rect(0, 0, hw * 0.8f, hh * 0.8f, 0.1f, 0.1f, 0.1f, true);
+    float windowW = hw * (isVertical ? 0.7f : 0.5f);
+    float windowH = hh * (isVertical ? 0.5f : 0.7f);
+    rect(0, 0, windowW, windowH, 0.2f, 0.3f, 0.4f, false);
+    if(isVertical) {
+        float frontY = (direction == 'N') ? hh * 0.3f : -hh * 0.3f;
+        rect(0, frontY, windowW, windowH * 0.4f, 0.3f, 0.4f, 0.5f, false);
+    } else {
+        float frontX = (direction == 'E') ? hw * 0.3f : -hw * 0.3f;
+        rect(frontX, 0, windowW * 0.4f, windowH, 0.3f, 0.4f, 0.5f, false);
     }
-    
-    void update(float dt) {
-        if(emergencyMode) {
-            emergencyTimer += dt;
-            if(emergencyTimer > 30.0f) {
-                emergencyMode = false;
-                printf("Emergency mode auto-cleared after 30 seconds\n");
-            }
-        }
-        if(!manual && !emergencyMode) {
-            static float cycleTimer = 0.0f;
-            static int currentAxis = 0;
-            cycleTimer += dt;
-            if(cycleTimer > 10.0f) {
-                if(currentAxis == 0) {
-                    north.setState(LightState::RED);
-                    south.setState(LightState::RED);
-                    east.setState(LightState::GREEN);
-                    west.setState(LightState::GREEN);
-                    currentAxis = 1;
-                } else {
-                    east.setState(LightState::RED);
-                    west.setState(LightState::RED);
-                    north.setState(LightState::GREEN);
-                    south.setState(LightState::GREEN);
-                    currentAxis = 0;
+    float wheelSize = std::min(hw, hh) * 0.12f;
+    float ax = isVertical ? 0.8f : 0.35f;
+    float ay = isVertical ? 0.35f : 0.8f;
+    const float wheels[4][2] = { {-1, 1}, {1, 1}, {-1, -1}, {1, -1} };
+    for(auto& w : wheels) circle(hw * ax * w[0], hh * ay * w[1], wheelSize, 0.1f, 0.1f, 0.1f);
+    for(auto& w : wheels) circle(hw * ax * w[0], hh * ay * w[1], wheelSize * 0.6f, 0.4f, 0.4f, 0.4f);
+    float stripeR = (lane == 0) ? 0.2f : 0.8f;
+    float stripeG = (lane == 0) ? 0.8f : 0.2f;
+    float stripeB = 0.3f;
+    if(isVertical) rect((lane == 0) ? -hw * 0.9f : hw * 0.9f, 0, hw * 0.1f, hh * 0.6f, stripeR, stripeG, stripeB, false);
+    else rect(0, (lane == 0) ? -hh * 0.9f : hh * 0.9f, hw * 0.6f, hh * 0.1f, stripeR, stripeG, stripeB, false);
+}
+
+static void carColor(const Car& c, float& r, float& g, float& b){
+    r = 0.3f + (c.x * 0.1f) - floor(c.x * 0.1f);
+    g = 0.4f + (c.y * 0.15f) - floor(c.y * 0.15f);
+    b = 0.5f + ((c.x + c.y) * 0.1f) - floor((c.x + c.y) * 0.1f);
+    r = std::max(0.2f, std::min(0.9f, r));
+    g = std::max(0.2f, std::min(0.9f, g));
+    b = std::max(0.2f, std::min(0.9f, b));
+}
+
+struct CarInstance { float x, y, templ, r, g, b; };
+
+// Every (direction, lane stripe) car shape is baked once into a texture buffer at
+// init; a frame then streams one CarInstance per car and issues one instanced draw.
+class CarMesh {
+public:
+    static const int kTemplates = LaneIndex::kLanes;
+    static const int kVertsPerCar = kCarParts * 6;
+    GLuint prog=0, vao=0, instVbo=0, meshVbo=0, meshTex=0;
+    GLint locProj=-1;
+    size_t capacity=0;
+    std::vector<CarInstance> items;
+
+    void initGL(){
+        prog = makeProgram(kCarVS, kFS);
+        locProj = glGetUniformLocation(prog, "uProj");
+        glUseProgram(prog);
+        glUniform1i(glGetUniformLocation(prog, "uMesh"), 0);
+        glUniform1i(glGetUniformLocation(prog, "uVertsPerCar"), kVertsPerCar);
+
+        const Car proto;
+        const float corners[6][2] = { {-1,-1}, {1,-1}, {-1,1}, {1,-1}, {1,1}, {-1,1} };
+        std::vector<float> mesh;
+        std::vector<CarPart> parts;
+        for(int t = 0; t < kTemplates; t++){
+            parts.clear();
+            carParts(parts, proto.w * 0.5f, proto.h * 0.5f, "NSEW"[t / 2], t & 1);
+            if(parts.size() != size_t(kCarParts)){
+                fprintf(stderr, "carParts made %zu parts, kCarParts is %d\n", parts.size(), kCarParts);
+                abort();
+            }
+            for(const auto& p : parts){
+                float flags = float((p.tint ? 1 : 0) | (p.s.shape == float(SHAPE_CIRCLE) ? 2 : 0));
+                for(auto& c : corners){
+                    float v[8] = { p.s.x + c[0] * p.s.hw, p.s.y + c[1] * p.s.hh, c[0], c[1], p.s.r, p.s.g, p.s.b, flags };
+                    mesh.insert(mesh.end(), v, v + 8);
                 }
-                cycleTimer = 0.0f;
             }
-        } else {
-            north.update(dt);
-            south.update(dt);
-            east.update(dt);
-            west.update(dt);
         }
+        glGenBuffers(1, &meshVbo);
+        glBindBuffer(GL_TEXTURE_BUFFER, meshVbo);
+        glBufferData(GL_TEXTURE_BUFFER, mesh.size() * sizeof(float), mesh.data(), GL_STATIC_DRAW);
+        glGenTextures(1, &meshTex);
+        glBindTexture(GL_TEXTURE_BUFFER, meshTex);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, meshVbo);
+
+        glGenVertexArrays(1, &vao); glGenBuffers(1, &instVbo);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, instVbo);
+        glVertexAttribPointer(0,2,GL_FLOAT,GL_FALSE,sizeof(CarInstance),(void*)offsetof(CarInstance,x));
+        glVertexAttribPointer(1,1,GL_FLOAT,GL_FALSE,sizeof(CarInstance),(void*)offsetof(CarInstance,templ));
+        glVertexAttribPointer(2,3,GL_FLOAT,GL_FALSE,sizeof(CarInstance),(void*)offsetof(CarInstance,r));
+        for(int a = 0; a <= 2; a++){ glEnableVertexAttribArray(a); glVertexAttribDivisor(a, 1); }
+        glBindVertexArray(0);
     }
-    
-    bool nsProceed() const { return north.state == LightState::GREEN || south.state == LightState::GREEN; }
-    bool ewProceed() const { return east.state == LightState::GREEN || west.state == LightState::GREEN; }
-};
 
-class Car {
-public:
-    float x=0, y=0; 
-    float vx=0, vy=0; 
-    float speed=6.0f; 
-    float w=1.6f, h=0.9f; 
-    bool active=true;
-    int lane=0; 
-    char axis='N'; 
-    
-    void update(float dt){ x += vx*speed*dt; y += vy*speed*dt; }
+    void add(const Car& c, float alpha){
+        Car at = c;
+        at.x = c.px + (c.x - c.px) * alpha;
+        at.y = c.py + (c.y - c.py) * alpha;
+        CarInstance in;
+        in.x = at.x; in.y = at.y;
+        in.templ = float(LaneIndex::key(c.axis, c.lane));
+        carColor(at, in.r, in.g, in.b);
+        items.push_back(in);
+    }
+
+    void flush(const float* proj, RenderStats& stats){
+        if(items.empty()) return;
+        glUseProgram(prog);
+        glUniformMatrix4fv(locProj, 1, GL_FALSE, proj);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_BUFFER, meshTex);
+        glBindBuffer(GL_ARRAY_BUFFER, instVbo);
+        if(items.size() > capacity){
+            capacity = items.size() * 2;
+            glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(CarInstance), nullptr, GL_STREAM_DRAW);
+            stats.uploads++;
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, items.size() * sizeof(CarInstance), items.data());
+        glBindVertexArray(vao);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, kVertsPerCar, GLsizei(items.size()));
+        stats.stateChanges += 6;
+        stats.uploads++;
+        stats.drawCalls++;
+        stats.instances += int(items.size());
+    }
 };
 
-class World {
+class Renderer {
 public:
     Ortho cam;
-    GLuint prog=0, vao=0, vbo=0;
-    TrafficLightSystem light;
-    std::vector<Car> cars;
-    float spawnIntervalNS = 2.2f;
-    float spawnIntervalEW = 2.2f;
-    float spawnTimerNS = 0.f;
-    float spawnTimerEW = 0.f;
-    bool paused=false;
-    std::mt19937 rng{12345};
-    const float stopNS = 2.5f; 
-    const float stopEW = 4.0f; 
-    const float roadHalf = 3.0f; 
+    GLuint prog=0, quadVbo=0;
+    GLint locProj=-1;
+    ShapeLayer layers[LAYER_COUNT];
+    Layer layer=LAYER_ROAD;
+    CarMesh carMesh;
+    RoadKey roadKey;
+    bool roadBuilt=false;
+    RenderStats stats;
     
     void initGL(){
-        prog = makeProgram();
-        glUseProgram(prog);
+        prog = makeProgram(kVS, kFS);
+        locProj = glGetUniformLocation(prog, "uProj");
         float verts[] = { -1,-1, 1,-1, -1,1, 1,1 };
-        glGenVertexArrays(1,&vao); glGenBuffers(1,&vbo);
-        glBindVertexArray(vao); glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glGenBuffers(1,&quadVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, quadVbo);
         glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
-        glVertexAttribPointer(0,2,GL_FLOAT,GL_FALSE,2*sizeof(float),(void*)0);
-        glEnableVertexAttribArray(0);
+        for(auto& L : layers){
+            glGenVertexArrays(1,&L.vao); glGenBuffers(1,&L.vbo);
+            glBindVertexArray(L.vao);
+            glBindBuffer(GL_ARRAY_BUFFER, quadVbo);
+            glVertexAttribPointer(0,2,GL_FLOAT,GL_FALSE,2*sizeof(float),(void*)0);
+            glEnableVertexAttribArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, L.vbo);
+            glVertexAttribPointer(1,2,GL_FLOAT,GL_FALSE,sizeof(ShapeInstance),(void*)offsetof(ShapeInstance,x));
+            glVertexAttribPointer(2,2,GL_FLOAT,GL_FALSE,sizeof(ShapeInstance),(void*)offsetof(ShapeInstance,hw));
+            glVertexAttribPointer(3,3,GL_FLOAT,GL_FALSE,sizeof(ShapeInstance),(void*)offsetof(ShapeInstance,r));
+            glVertexAttribPointer(4,1,GL_FLOAT,GL_FALSE,sizeof(ShapeInstance),(void*)offsetof(ShapeInstance,shape));
+            for(int a = 1; a <= 4; a++){ glEnableVertexAttribArray(a); glVertexAttribDivisor(a, 1); }
+        }
         glBindVertexArray(0);
+        layers[LAYER_ROAD].persistent = true;
+        carMesh.initGL();
         cam.update();
     }
     
     void drawRect(float cx, float cy, float hw, float hh, float r, float g, float b){
-        glUseProgram(prog);
-        GLint locP = glGetUniformLocation(prog, "uProj");
-        GLint locPos = glGetUniformLocation(prog, "uPos");
-        GLint locScale = glGetUniformLocation(prog, "uScale");
-        GLint locColor = glGetUniformLocation(prog, "uColor");
-        glUniformMatrix4fv(locP, 1, GL_FALSE, cam.mat);
-        glUniform2f(locPos, cx, cy);
-        glUniform2f(locScale, hw, hh);
-        glUniform3f(locColor, r,g,b);
-        glBindVertexArray(vao);
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        glBindVertexArray(0);
+        layers[layer].items.push_back({cx, cy, hw, hh, r, g, b, float(SHAPE_RECT)});
+        layers[layer].dirty = true;
     }
     
-    void drawCircle(float cx, float cy, float radius, float r, float g, float b){
-        const int rings = 8;
-        const int segments = 16;
-        for(int ring = 0; ring < rings; ring++){
-            float ringRadius = radius * (ring + 1) / rings;
-            float rectSize = radius * 0.15f;
-            for(int i = 0; i < segments; i++){
-                float angle = (2.0f * M_PI * i) / segments;
-                float x = cx + std::cos(angle) * ringRadius;
-                float y = cy + std::sin(angle) * ringRadius;
-                drawRect(x, y, rectSize, rectSize, r, g, b);
+    void beginFrame(){
+        for(auto& L : layers) if(!L.persistent) L.items.clear();
+        carMesh.items.clear();
+        layer = LAYER_ROAD;
+        stats = RenderStats();
+    }
+    
+    // One upload and one instanced draw per non-empty layer; baked cars go right
+    // after the vehicle layer.
+    void flush(){
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        stats.stateChanges += 2;
+        for(int i = 0; i < LAYER_COUNT; i++){
+            ShapeLayer& L = layers[i];
+            if(!L.items.empty()){
+                glUseProgram(prog);
+                glUniformMatrix4fv(locProj, 1, GL_FALSE, cam.mat);
+                stats.stateChanges += 3;
+                if(L.dirty){
+                    glBindBuffer(GL_ARRAY_BUFFER, L.vbo);
+                    stats.stateChanges++;
+                    size_t bytes = L.items.size() * sizeof(ShapeInstance);
+                    if(L.persistent){
+                        L.capacity = L.items.size();
+                        glBufferData(GL_ARRAY_BUFFER, bytes, L.items.data(), GL_STATIC_DRAW);
+                    } else {
+                        if(L.items.size() > L.capacity){
+                            L.capacity = L.items.size() * 2;
+                            glBufferData(GL_ARRAY_BUFFER, L.capacity * sizeof(ShapeInstance), nullptr, GL_STREAM_DRAW);
+                            stats.uploads++;
+                        }
+                        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, L.items.data());
+                    }
+                    stats.uploads++;
+                    L.dirty = false;
+                }
+                glBindVertexArray(L.vao);
+                glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(L.items.size()));
+                stats.drawCalls++;
+                stats.instances += int(L.items.size());
             }
+            if(i == LAYER_VEHICLES) carMesh.flush(cam.mat, stats);
         }
-        drawRect(cx, cy, radius * 0.4f, radius * 0.4f, r, g, b);
+        glBindVertexArray(0);
+        stats.stateChanges++;
+    }
+    
+    void drawCircle(float cx, float cy, float radius, float r, float g, float b){
+        layers[layer].items.push_back({cx, cy, radius, radius, r, g, b, float(SHAPE_CIRCLE)});
+        layers[layer].dirty = true;
     }
     
     void drawTrafficLight(float cx, float cy, bool isVertical, LightState state){
@@ -278,416 +428,369 @@ public:
         }
     }
     
-    void drawCarDetailed(float cx, float cy, float hw, float hh, char direction, int lane, float r, float g, float b){
-        bool isVertical = (direction == 'N' || direction == 'S');
-        drawRect(cx, cy, hw, hh, r, g, b);
-        float highlightW = hw * 0.8f;
-        float highlightH = hh * 0.8f;
-        drawRect(cx, cy, highlightW, highlightH, r + 0.1f, g + 0.1f, b + 0.1f);
-        float windowW = hw * (isVertical ? 0.7f : 0.5f);
-        float windowH = hh * (isVertical ? 0.5f : 0.7f);
-        drawRect(cx, cy, windowW, windowH, 0.2f, 0.3f, 0.4f);
-        if(isVertical) {
-            float frontY = (direction == 'N') ? cy + hh * 0.3f : cy - hh * 0.3f;
-            drawRect(cx, frontY, windowW, windowH * 0.4f, 0.3f, 0.4f, 0.5f);
-        } else {
-            float frontX = (direction == 'E') ? cx + hw * 0.3f : cx - hw * 0.3f;
-            drawRect(frontX, cy, windowW * 0.4f, windowH, 0.3f, 0.4f, 0.5f);
+    // Road slabs, lane markings and stop lines. Built into the persistent road layer
+    // and only rebuilt when the camera extents or the stop line geometry change.
+    void buildRoad(const RoadKey& k){
+        layers[LAYER_ROAD].items.clear();
+        layer = LAYER_ROAD;
+        float cx = (k.l + k.r) * 0.5f, cy = (k.b + k.t) * 0.5f;
+        drawRect(cx,0, (k.r - k.l) * 0.5f, k.roadHalf, 0.18f,0.18f,0.18f);
+        drawRect(0,cy, k.roadHalf, (k.t - k.b) * 0.5f, 0.18f,0.18f,0.18f);
+        float y=k.b; while(y<k.t){
+            drawRect(0,y,0.05f, 0.35f, 1,1,0);
+            y+=0.7f;
         }
-        float wheelSize = std::min(hw, hh) * 0.12f;
-        if(isVertical) {
-            drawCircle(cx - hw * 0.8f, cy + hh * 0.35f, wheelSize, 0.1f, 0.1f, 0.1f);
-            drawCircle(cx + hw * 0.8f, cy + hh * 0.35f, wheelSize, 0.1f, 0.1f, 0.1f);
-            drawCircle(cx - hw * 0.8f, cy - hh * 0.35f, wheelSize, 0.1f, 0.1f, 0.1f);
-            drawCircle(cx + hw * 0.8f, cy - hh * 0.35f, wheelSize, 0.1f, 0.1f, 0.1f);
-            float rimSize = wheelSize * 0.6f;
-            drawCircle(cx - hw * 0.8f, cy + hh * 0.35f, rimSize, 0.4f, 0.4f, 0.4f);
-            drawCircle(cx + hw * 0.8f, cy + hh * 0.35f, rimSize, 0.4f, 0.4f, 0.4f);
-            drawCircle(cx - hw * 0.8f, cy - hh * 0.35f, rimSize, 0.4f, 0.4f, 0.4f);
-            drawCircle(cx + hw * 0.8f, cy - hh * 0.35f, rimSize, 0.4f, 0.4f, 0.4f);
-        } else {
-            drawCircle(cx - hw * 0.35f, cy + hh * 0.8f, wheelSize, 0.1f, 0.1f, 0.1f);
-            drawCircle(cx - hw * 0.35f, cy - hh * 0.8f, wheelSize, 0.1f, 0.1f, 0.1f);
-            drawCircle(cx + hw * 0.35f, cy + hh * 0.8f, wheelSize, 0.1f, 0.1f, 0.1f);
-            drawCircle(cx + hw * 0.35f, cy - hh * 0.8f, wheelSize, 0.1f, 0.1f, 0.1f);
-            float rimSize = wheelSize * 0.6f;
-            drawCircle(cx - hw * 0.35f, cy + hh * 0.8f, rimSize, 0.4f, 0.4f, 0.4f);
-            drawCircle(cx - hw * 0.35f, cy - hh * 0.8f, rimSize, 0.4f, 0.4f, 0.4f);
-            drawCircle(cx + hw * 0.35f, cy + hh * 0.8f, rimSize, 0.4f, 0.4f, 0.4f);
-            drawCircle(cx + hw * 0.35f, cy - hh * 0.8f, rimSize, 0.4f, 0.4f, 0.4f);
-        }
-        
-        float stripeR = (lane == 0) ? 0.2f : 0.8f;  
-        float stripeG = (lane == 0) ? 0.8f : 0.2f;
-        float stripeB = 0.3f;
-        if(isVertical) {
-            float stripeX = (lane == 0) ? cx - hw * 0.9f : cx + hw * 0.9f;
-            drawRect(stripeX, cy, hw * 0.1f, hh * 0.6f, stripeR, stripeG, stripeB);
-        } else {
-            float stripeY = (lane == 0) ? cy - hh * 0.9f : cy + hh * 0.9f;
-            drawRect(cx, stripeY, hw * 0.6f, hh * 0.1f, stripeR, stripeG, stripeB);
+        float x=k.l; while(x<k.r){
+            drawRect(x,0, 0.35f,0.05f, 1,1,0);
+            x+=0.7f;
         }
+        y=k.b; while(y<k.t){ drawRect(-2.0f,y,0.03f, 0.3f, 1,1,1); y+=0.6f; }
+        y=k.b; while(y<k.t){ drawRect(2.0f,y,0.03f, 0.3f, 1,1,1); y+=0.6f; }
+        x=k.l; while(x<k.r){ drawRect(x,-2.0f, 0.3f,0.03f, 1,1,1); x+=0.6f; }
+        x=k.l; while(x<k.r){ drawRect(x,2.0f, 0.3f,0.03f, 1,1,1); x+=0.6f; }
+        drawRect(0, k.stopNS, k.roadHalf, 0.06f, 1,0,0);
+        drawRect(0,-k.stopNS, k.roadHalf, 0.06f, 1,0,0);
+        drawRect(-k.stopEW, 0, 0.06f, k.roadHalf, 1,0,0);
+        drawRect( k.stopEW, 0, 0.06f, k.roadHalf, 1,0,0);
     }
     
-    void drawWorld(){
-        drawRect(0,0, 20, roadHalf, 0.18f,0.18f,0.18f); 
-        drawRect(0,0, roadHalf, 12, 0.18f,0.18f,0.18f); 
-        float y=-12; while(y<12){ 
-            drawRect(0,y,0.05f, 0.35f, 1,1,0); 
-            y+=0.7f; 
-        }
-        float x=-20; while(x<20){ 
-            drawRect(x,0, 0.35f,0.05f, 1,1,0); 
-            x+=0.7f; 
+    // alpha interpolates cars between their previous and current simulated position.
+    void drawWorld(const WorldSnapshot& world, float alpha = 1.0f){
+        auto t0 = std::chrono::steady_clock::now();
+        beginFrame();
+        RoadKey key{cam.l, cam.r, cam.b, cam.t, world.stopNS, world.stopEW, world.roadHalf};
+        if(!roadBuilt || !(key == roadKey)){
+            buildRoad(key);
+            roadKey = key;
+            roadBuilt = true;
         }
-        y=-12; while(y<12){ drawRect(-2.0f,y,0.03f, 0.3f, 1,1,1); y+=0.6f; }
-        y=-12; while(y<12){ drawRect(2.0f,y,0.03f, 0.3f, 1,1,1); y+=0.6f; }
-        x=-20; while(x<20){ drawRect(x,-2.0f, 0.3f,0.03f, 1,1,1); x+=0.6f; }
-        x=-20; while(x<20){ drawRect(x,2.0f, 0.3f,0.03f, 1,1,1); x+=0.6f; }
-        drawRect(0, stopNS, roadHalf, 0.06f, 1,0,0);
-        drawRect(0,-stopNS, roadHalf, 0.06f, 1,0,0);
-        drawRect(-stopEW, 0, 0.06f, roadHalf, 1,0,0);
-        drawRect( stopEW, 0, 0.06f, roadHalf, 1,0,0);
-         
-        drawTrafficLight(-3.0f, -3.5f, true, light.north.state);
-        drawTrafficLight(3.0f, 3.5f, true, light.south.state);     
-        drawTrafficLight(-5.5f, -3.0f, false, light.east.state); 
-        drawTrafficLight(5.5f, 3.0f, false, light.west.state);   
-        for(const auto& c : cars){ 
-            if(!c.active) continue; 
-            float carR = 0.3f + (c.x * 0.1f) - floor(c.x * 0.1f);  
-            float carG = 0.4f + (c.y * 0.15f) - floor(c.y * 0.15f);
-            float carB = 0.5f + ((c.x + c.y) * 0.1f) - floor((c.x + c.y) * 0.1f);
-            carR = std::max(0.2f, std::min(0.9f, carR));
-            carG = std::max(0.2f, std::min(0.9f, carG));
-            carB = std::max(0.2f, std::min(0.9f, carB));
-            drawCarDetailed(c.x, c.y, c.w*0.5f, c.h*0.5f, c.axis, c.lane, carR, carG, carB); 
-        }
-        drawRect(-18.5f,10.5f, 1.5f,0.7f, light.manual?1.f:0.1f, light.manual?0.5f:0.8f, 0.1f);
-        if(light.emergencyMode) {
+        layer = LAYER_SIGNALS;
+        drawTrafficLight(-3.0f, -3.5f, true, world.north);
+        drawTrafficLight(3.0f, 3.5f, true, world.south);
+        drawTrafficLight(-5.5f, -3.0f, false, world.east);
+        drawTrafficLight(5.5f, 3.0f, false, world.west);
+        layer = LAYER_VEHICLES;
+        for(const Car& c : world.cars) carMesh.add(c, alpha);
+        layer = LAYER_HUD;
+        drawRect(-18.5f,10.5f, 1.5f,0.7f, world.manual?1.f:0.1f, world.manual?0.5f:0.8f, 0.1f);
+        if(world.emergencyMode) {
             float flash = sin(glfwGetTime() * 6.0f) * 0.5f + 0.5f; 
             drawRect(-15.5f, 10.5f, 2.0f, 0.7f, 1.0f, flash * 0.3f, flash * 0.3f);
         }
+        flush();
+        stats.submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
     }
-    
-    bool hasFrontCarTooClose(const Car& me) const {
-        const float headway = 1.8f; 
-        for(const auto& c : cars){
-            if(!c.active || &c==&me) continue;
-            if(c.axis!=me.axis || c.lane!=me.lane) continue;
-            if(me.vx>0 && std::abs(c.y-me.y)<0.8f && c.x>me.x && (c.x - me.x) < (me.w+headway)) return true;
-            if(me.vx<0 && std::abs(c.y-me.y)<0.8f && c.x<me.x && (me.x - c.x) < (me.w+headway)) return true;
-            if(me.vy>0 && std::abs(c.x-me.x)<0.8f && c.y>me.y && (c.y - me.y) < (me.h+headway)) return true;
-            if(me.vy<0 && std::abs(c.x-me.x)<0.8f && c.y<me.y && (me.y - c.y) < (me.h+headway)) return true;
-        }
-        return false;
+};
+
+// Operator commands on their way to the simulation thread.
+static CommandQueue gCommands;
+
+static void send(CommandType type, uint8_t head = 0, uint8_t value = 0, uint8_t flags = 0, float delta = 0){
+    Command c; c.type = type; c.head = head; c.value = value; c.flags = flags; c.delta = delta;
+    if(!submitCommand(gCommands, c)) fprintf(stderr, "Command dropped: simulation is not keeping up\n");
+}
+
+// Translates key presses into commands; the simulation applies them between ticks.
+// Head keys only act under manual control, which the simulation checks when it
+// applies them, so a key pressed right after M is not lost.
+static void keyCallback(GLFWwindow* win, int key, int scancode, int action, int mods){
+    if(action!=GLFW_PRESS) return;
+    const uint8_t manualOnly = kCommandManualOnly;
+    const uint8_t red = uint8_t(LightState::RED), yellow = uint8_t(LightState::YELLOW), green = uint8_t(LightState::GREEN);
+    if(key==GLFW_KEY_ESCAPE){
+        glfwSetWindowShouldClose(win,1);
+        if(mods == GLFW_MOD_SHIFT) send(CommandType::SetEmergency, 0, 0, manualOnly);
     }
-    
-    bool shouldStopAtSignal(const Car& c) const {
-        const float stopGap = 1.6f; 
-        const float goOnYellowThreshold = 1.0f; 
-        const float interHalfX = 1.5f, interHalfY = 1.5f;
-        if(std::abs(c.x) < interHalfX && std::abs(c.y) < interHalfY) return false;
-        if(c.axis=='N'){ 
-            float dist = (-stopNS) - c.y; 
-            if(dist < -0.5f) return false; 
-            if(light.north.state == LightState::GREEN) return false; 
-            if(light.north.state == LightState::YELLOW){ return !(dist <= goOnYellowThreshold); }
-            return dist <= stopGap;
-        } else if(c.axis=='S'){ 
-            float dist = c.y - stopNS; 
-            if(dist < -0.5f) return false;
-            if(light.south.state == LightState::GREEN) return false;
-            if(light.south.state == LightState::YELLOW){ return !(dist <= goOnYellowThreshold); }
-            return dist <= stopGap;
-        } else if(c.axis=='E'){ 
-            float dist = (-stopEW) - c.x; 
-            if(dist < -0.5f) return false; 
-            if(light.east.state == LightState::GREEN) return false; 
-            if(light.east.state == LightState::YELLOW){ return !(dist <= goOnYellowThreshold); }
-            return dist <= stopGap;
-        } else if(c.axis=='W'){ 
-            float dist = c.x - stopEW; 
-            if(dist < -0.5f) return false;
-            if(light.west.state == LightState::GREEN) return false;
-            if(light.west.state == LightState::YELLOW){ return !(dist <= goOnYellowThreshold); }
-            return dist <= stopGap;
+    if(key==GLFW_KEY_P) send(CommandType::Pause, 0, kCommandToggle);
+    if(key==GLFW_KEY_M) send(CommandType::SetManual, 0, kCommandToggle);
+    if(key==GLFW_KEY_A) send(CommandType::SetManual, 0, 0);
+    // Arrows cycle a head; with Shift they force it green in emergency mode.
+    const int arrows[4] = { GLFW_KEY_UP, GLFW_KEY_DOWN, GLFW_KEY_RIGHT, GLFW_KEY_LEFT };
+    for(uint8_t h = 0; h < 4; h++){
+        if(key != arrows[h]) continue;
+        if(mods == GLFW_MOD_SHIFT){
+            send(CommandType::SetManual, 0, 1);
+            send(CommandType::SetLightState, h, green);
+            send(CommandType::SetEmergency, 0, 1);
+            printf("EMERGENCY OVERRIDE: %s lane GREEN\n", h == 0 ? "North" : h == 1 ? "South" : h == 2 ? "East" : "West");
+        } else {
+            send(CommandType::CycleLight, h, 0, manualOnly);
         }
-        return false;
     }
-    
-    void cullCars(){
-        cars.erase(std::remove_if(cars.begin(), cars.end(), [&](const Car& c){
-            return (std::abs(c.x)>22 || std::abs(c.y)>14) || !c.active; }), cars.end());
+    // Red, yellow, green per head: 1-3 north, 4-6 south, Q/W/E east, Z/X/C west.
+    const int direct[4][3] = {
+        { GLFW_KEY_1, GLFW_KEY_2, GLFW_KEY_3 }, { GLFW_KEY_4, GLFW_KEY_5, GLFW_KEY_6 },
+        { GLFW_KEY_Q, GLFW_KEY_W, GLFW_KEY_E }, { GLFW_KEY_Z, GLFW_KEY_X, GLFW_KEY_C },
+    };
+    const uint8_t order[3] = { red, yellow, green };
+    for(uint8_t h = 0; h < 4; h++)
+        for(int k = 0; k < 3; k++) if(key == direct[h][k]) send(CommandType::SetLightState, h, order[k], manualOnly);
+    if(key==GLFW_KEY_R || key==GLFW_KEY_G){
+        for(uint8_t h = 0; h < 4; h++) send(CommandType::SetLightState, h, key==GLFW_KEY_R ? red : green, manualOnly);
     }
-    
-    void spawnCars(float dt){
-        spawnTimerNS += dt; spawnTimerEW += dt;
-        if(spawnTimerNS >= spawnIntervalNS){
-            spawnTimerNS = 0.f;
-            Car cN; cN.lane=0; cN.axis='N'; cN.active=true;
-            cN.x = -1.0f; cN.y = -12.5f; cN.vx=0; cN.vy=1; 
-            Car cS; cS.lane=1; cS.axis='S'; cS.active=true;
-            cS.x = 1.0f; cS.y = 12.5f; cS.vx=0; cS.vy=-1; 
-            bool okN=true, okS=true;
-            for(const auto& o: cars){
-                if(!o.active) continue;
-                if(o.axis=='N' && o.lane==0 && std::abs(o.x-cN.x)<0.8f && (cN.y - o.y) < 4.0f) okN=false;
-                if(o.axis=='S' && o.lane==1 && std::abs(o.x-cS.x)<0.8f && (o.y - cS.y) < 4.0f) okS=false;
-            }
-            if(okN) cars.push_back(cN);
-            if(okS) cars.push_back(cS);
-        }
-        if(spawnTimerEW >= spawnIntervalEW){
-            spawnTimerEW = 0.f;
-            Car cE; cE.lane=0; cE.axis='E'; cE.active=true;
-            cE.y = -1.0f; cE.x = -20.5f; cE.vx=1; cE.vy=0; 
-            Car cW; cW.lane=1; cW.axis='W'; cW.active=true;
-            cW.y = 1.0f; cW.x = 20.5f; cW.vx=-1; cW.vy=0; 
-            bool okE=true, okW=true;
-            for(const auto& o: cars){
-                if(!o.active) continue;
-                if(o.axis=='E' && o.lane==0 && std::abs(o.y-cE.y)<0.8f && (o.x - cE.x) < 6.0f) okE=false;
-                if(o.axis=='W' && o.lane==1 && std::abs(o.y-cW.y)<0.8f && (cW.x - o.x) < 6.0f) okW=false;
-            }
-            if(okE) cars.push_back(cE);
-            if(okW) cars.push_back(cW);
+    if(key==GLFW_KEY_EQUAL) send(CommandType::AdjustSpawn, 0, 0, 0, -0.2f);
+    if(key==GLFW_KEY_MINUS) send(CommandType::AdjustSpawn, 0, 0, 0, 0.2f);
+}
+
+// Fixed scene for --bench: n cars spread over the four approaches, moved along their
+// lane by a scripted amount each frame, and the heads stepped through a fixed cycle.
+// Nothing depends on the wall clock, so every run draws the same frames.
+static void scriptFrame(World& world, size_t n, int frame){
+    if(world.cars.live() != n){
+        world.cars = VehicleStore(n);
+        world.lanes.clear();
+        for(size_t i = 0; i < n; i++){
+            Car c; c.axis = "NSEW"[i % 4]; c.lane = int(i % 4) & 1;
+            c.vx = c.axis=='E' ? 1.f : c.axis=='W' ? -1.f : 0.f;
+            c.vy = c.axis=='N' ? 1.f : c.axis=='S' ? -1.f : 0.f;
+            world.addCar(c);
         }
+        world.light.setManual(true);
     }
-    
-    void update(float dt){
-        if(paused) return;
-        light.update(dt);
-        spawnCars(dt);
-        for(auto &c : cars){
-            if(!c.active) continue;
-            bool stop = shouldStopAtSignal(c) || hasFrontCarTooClose(c);
-            if(!stop) c.update(dt);
-            if(std::abs(c.x)>22 || std::abs(c.y)>14) c.active=false;
-        }
-        cullCars();
+    for(size_t i = 0; i < n; i++){
+        char axis = char(world.cars.axis[i]);
+        float span = (axis=='N' || axis=='S') ? 28.f : 44.f;
+        float along = std::fmod(float(i / 4) * 37.f / 1000.f * span + frame * 0.1f, span) - span * 0.5f;
+        float cross = (axis=='N' || axis=='W') ? -1.f : 1.f;
+        if(axis=='S' || axis=='W') along = -along;
+        world.cars.x[i] = world.cars.px[i] = (axis=='N' || axis=='S') ? cross : along;
+        world.cars.y[i] = world.cars.py[i] = (axis=='N' || axis=='S') ? along : cross;
+        world.cars.stop[i] = 0;
     }
-};
+    if(frame % 60 == 0){
+        const LightState cycle[4] = { LightState::GREEN, LightState::YELLOW, LightState::RED, LightState::RED };
+        int c = frame / 60;
+        world.light.north.setState(cycle[c % 4]);
+        world.light.south.setState(cycle[c % 4]);
+        world.light.east.setState(cycle[(c + 2) % 4]);
+        world.light.west.setState(cycle[(c + 2) % 4]);
+    }
+}
 
-static World* gWorld = nullptr;
+// Draws the scripted scene for a number of frames on the current context and prints
+// CPU submit time (drawWorld up to the last GL call), draw calls and state changes.
+static int runRenderBench(int frames, size_t cars){
+    printf("renderer:     %s\n", (const char*)glGetString(GL_RENDERER));
+    World world;
+    WorldSnapshot snap;
+    Renderer renderer; renderer.initGL();
+    glViewport(0, 0, 1280, 720);
+    std::vector<double> submit;
+    double frameSum = 0;
+    long long draws = 0, changes = 0, uploads = 0, instances = 0;
+    for(int f = 0; f < frames; f++){
+        scriptFrame(world, cars, f);
+        snap.capture(world, uint64_t(f));
+        auto t0 = std::chrono::steady_clock::now();
+        glClearColor(0.08f,0.09f,0.11f,1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        renderer.drawWorld(snap);
+        glFinish();
+        frameSum += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        submit.push_back(renderer.stats.submitMs);
+        draws += renderer.stats.drawCalls; changes += renderer.stats.stateChanges;
+        uploads += renderer.stats.uploads; instances += renderer.stats.instances;
+    }
+    if(GLenum err = glGetError()) fprintf(stderr, "GL error 0x%x\n", err);
+    double sum = 0;
+    for(double ms : submit) sum += ms;
+    std::sort(submit.begin(), submit.end());
+    printf("frames:       %d\n", frames);
+    printf("cars:         %zu\n", cars);
+    printf("submit:       %.4f ms mean, %.4f ms median, %.4f ms p95\n", sum / frames,
+           submit[submit.size() / 2], submit[std::min(submit.size() - 1, submit.size() * 95 / 100)]);
+    printf("frame:        %.4f ms mean incl. glFinish\n", frameSum / frames);
+    printf("draw calls:   %.1f per frame\n", double(draws) / frames);
+    printf("state changes:%.1f per frame\n", double(changes) / frames);
+    printf("uploads:      %.1f per frame\n", double(uploads) / frames);
+    printf("instances:    %.1f per frame\n", double(instances) / frames);
+    return 0;
+}
 
-static void keyCallback(GLFWwindow* win, int key, int scancode, int action, int mods){
-    if(action==GLFW_PRESS){
-        if(key==GLFW_KEY_ESCAPE) glfwSetWindowShouldClose(win,1);
-        if(key==GLFW_KEY_P) gWorld->paused = !gWorld->paused;
-        if(key==GLFW_KEY_M){ 
-            gWorld->light.setManual(!gWorld->light.manual); 
-            printf("Traffic Light: %s mode\n", gWorld->light.manual ? "Manual" : "Automatic");
-        }
-        if(key==GLFW_KEY_A){ 
-            gWorld->light.setManual(false); 
-            printf("Traffic Light: Automatic mode\n");
-        }
-        if (gWorld->light.manual) {
-            if (key == GLFW_KEY_UP && mods == GLFW_MOD_SHIFT) { 
-                gWorld->light.north.setState(LightState::GREEN);
-                gWorld->light.setEmergencyMode(true);
-                printf("EMERGENCY: North lane GREEN for emergency vehicle\n");
-            }
-            else if (key == GLFW_KEY_UP) { 
-                LightState current = gWorld->light.north.state;
-                if (current == LightState::RED) gWorld->light.north.setState(LightState::YELLOW);
-                else if (current == LightState::YELLOW) gWorld->light.north.setState(LightState::GREEN);
-                else gWorld->light.north.setState(LightState::RED);
-                printf("North light: %s\n", current == LightState::RED ? "YELLOW" : 
-                       current == LightState::YELLOW ? "GREEN" : "RED");
-            }
-            if (key == GLFW_KEY_DOWN && mods == GLFW_MOD_SHIFT) { 
-                gWorld->light.south.setState(LightState::GREEN);
-                gWorld->light.setEmergencyMode(true);
-                printf("EMERGENCY: South lane GREEN for emergency vehicle\n");
-            }
-            else if (key == GLFW_KEY_DOWN) { 
-                LightState current = gWorld->light.south.state;
-                if (current == LightState::RED) gWorld->light.south.setState(LightState::YELLOW);
-                else if (current == LightState::YELLOW) gWorld->light.south.setState(LightState::GREEN);
-                else gWorld->light.south.setState(LightState::RED);
-                printf("South light: %s\n", current == LightState::RED ? "YELLOW" : 
-                       current == LightState::YELLOW ? "GREEN" : "RED");
-            }
-            if (key == GLFW_KEY_RIGHT && mods == GLFW_MOD_SHIFT) { 
-                gWorld->light.east.setState(LightState::GREEN);
-                gWorld->light.setEmergencyMode(true);
-                printf("EMERGENCY: East lane GREEN for emergency vehicle\n");
-            }
-            else if (key == GLFW_KEY_RIGHT) { 
-                LightState current = gWorld->light.east.state;
-                if (current == LightState::RED) gWorld->light.east.setState(LightState::YELLOW);
-                else if (current == LightState::YELLOW) gWorld->light.east.setState(LightState::GREEN);
-                else gWorld->light.east.setState(LightState::RED);
-                printf("East light: %s\n", current == LightState::RED ? "YELLOW" : 
-                       current == LightState::YELLOW ? "GREEN" : "RED");
-            }
-            if (key == GLFW_KEY_LEFT && mods == GLFW_MOD_SHIFT) { 
-                gWorld->light.west.setState(LightState::GREEN);
-                gWorld->light.setEmergencyMode(true);
-                printf("EMERGENCY: West lane GREEN for emergency vehicle\n");
-            }
-            else if (key == GLFW_KEY_LEFT) { 
-                LightState current = gWorld->light.west.state;
-                if (current == LightState::RED) gWorld->light.west.setState(LightState::YELLOW);
-                else if (current == LightState::YELLOW) gWorld->light.west.setState(LightState::GREEN);
-                else gWorld->light.west.setState(LightState::RED);
-                printf("West light: %s\n", current == LightState::RED ? "YELLOW" : 
-                       current == LightState::YELLOW ? "GREEN" : "RED");
-            }
-            if (key == GLFW_KEY_1) { 
-                gWorld->light.north.setState(LightState::RED);
-                printf("North light: RED\n");
-            }
-            if (key == GLFW_KEY_2) { 
-                gWorld->light.north.setState(LightState::YELLOW);
-                printf("North light: YELLOW\n");
-            }
-            if (key == GLFW_KEY_3) { 
-                gWorld->light.north.setState(LightState::GREEN);
-                printf("North light: GREEN\n");
-            }
-            if (key == GLFW_KEY_4) { 
-                gWorld->light.south.setState(LightState::RED);
-                printf("South light: RED\n");
-            }
-            if (key == GLFW_KEY_5) { 
-                gWorld->light.south.setState(LightState::YELLOW);
-                printf("South light: YELLOW\n");
-            }
-            if (key == GLFW_KEY_6) { 
-                gWorld->light.south.setState(LightState::GREEN);
-                printf("South light: GREEN\n");
-            }
-            if (key == GLFW_KEY_Q) { 
-                gWorld->light.east.setState(LightState::RED);
-                printf("East light: RED\n");
-            }
-            if (key == GLFW_KEY_W) { 
-                gWorld->light.east.setState(LightState::YELLOW);
-                printf("East light: YELLOW\n");
-            }
-            if (key == GLFW_KEY_E) { 
-                gWorld->light.east.setState(LightState::GREEN);
-                printf("East light: GREEN\n");
-            }
-            if (key == GLFW_KEY_Z) { 
-                gWorld->light.west.setState(LightState::RED);
-                printf("West light: RED\n");
-            }
-            if (key == GLFW_KEY_X) { 
-                gWorld->light.west.setState(LightState::YELLOW);
-                printf("West light: YELLOW\n");
-            }
-            if (key == GLFW_KEY_C) { 
-                gWorld->light.west.setState(LightState::GREEN);
-                printf("West light: GREEN\n");
-            }
-            if (key == GLFW_KEY_R) { 
-                gWorld->light.north.setState(LightState::RED);
-                gWorld->light.south.setState(LightState::RED);
-                gWorld->light.east.setState(LightState::RED);
-                gWorld->light.west.setState(LightState::RED);
-                printf("EMERGENCY STOP: All lights RED\n");
-            }
-            if (key == GLFW_KEY_G) { 
-                gWorld->light.north.setState(LightState::GREEN);
-                gWorld->light.south.setState(LightState::GREEN);
-                gWorld->light.east.setState(LightState::GREEN);
-                gWorld->light.west.setState(LightState::GREEN);
-                printf("CAUTION: All lights GREEN (use carefully!)\n");
-            }
-            if (key == GLFW_KEY_ESCAPE && mods == GLFW_MOD_SHIFT) {
-                gWorld->light.setEmergencyMode(false);
-                printf("Emergency mode cleared\n");
+static double secondsNow(){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Simulation thread: ticks the world in real time at clock.step, applies queued
+// commands at tick boundaries and publishes a snapshot after every batch of ticks.
+// Nothing here waits on the renderer.
+static void simulate(World& world, FixedStepClock& clock, TripleBuffer<WorldSnapshot>& out,
+                     std::atomic<bool>& running, bool showStats, TelemetryWriter& telemetry, JournalWriter& journal){
+    uint64_t tick = 0;
+    uint32_t timeouts = 0;
+    const uint64_t tickNs = uint64_t(clock.step * 1e9);
+    CommandLatency latency;
+    double last = secondsNow(), statsStart = last;
+    while(running.load(std::memory_order_relaxed)){
+        double now = secondsNow();
+        int steps = clock.advance(now - last);
+        last = now;
+        for(int i = 0; i < steps; i++){
+            applyCommands(world, gCommands, tick, tickNs, latency, [&](const Command& c, bool applied){
+                journal.command(tick, c);
+                if(applied) printCommand(world, c);
+            });
+            world.update(float(clock.step));
+            if(world.light.emergencyTimeouts != timeouts){
+                timeouts = world.light.emergencyTimeouts;
+                printf("Emergency mode auto-cleared after 30 seconds\n");
             }
+            journal.ticked(tick, world);
+            tick++;
+            telemetry.publish(world, tick, double(tick) * clock.step);
         }
-        else {
-            if (key == GLFW_KEY_UP && mods == GLFW_MOD_SHIFT) { 
-                gWorld->light.setManual(true);
-                gWorld->light.north.setState(LightState::GREEN);
-                gWorld->light.setEmergencyMode(true);
-                printf("EMERGENCY OVERRIDE: Manual mode activated, North lane GREEN\n");
-            }
-            if (key == GLFW_KEY_DOWN && mods == GLFW_MOD_SHIFT) { 
-                gWorld->light.setManual(true);
-                gWorld->light.south.setState(LightState::GREEN);
-                gWorld->light.setEmergencyMode(true);
-                printf("EMERGENCY OVERRIDE: Manual mode activated, South lane GREEN\n");
-            }
-            if (key == GLFW_KEY_RIGHT && mods == GLFW_MOD_SHIFT) { 
-                gWorld->light.setManual(true);
-                gWorld->light.east.setState(LightState::GREEN);
-                gWorld->light.setEmergencyMode(true);
-                printf("EMERGENCY OVERRIDE: Manual mode activated, East lane GREEN\n");
-            }
-            if (key == GLFW_KEY_LEFT && mods == GLFW_MOD_SHIFT) { 
-                gWorld->light.setManual(true);
-                gWorld->light.west.setState(LightState::GREEN);
-                gWorld->light.setEmergencyMode(true);
-                printf("EMERGENCY OVERRIDE: Manual mode activated, West lane GREEN\n");
-            }
+        if(showStats && now - statsStart >= 1.0 && latency.count){
+            printf("commands: %llu applied, %.1f us mean, %.1f us max latency, %llu over one tick\n",
+                   (unsigned long long)latency.count, latency.meanUs(), double(latency.maxNs) * 1e-3,
+                   (unsigned long long)latency.overTick);
+            latency = CommandLatency();
+            statsStart = now;
+        }
+        if(steps){
+            out.back().capture(world, tick);
+            out.back().time = now;
+            out.publish();
         }
-        if(key==GLFW_KEY_EQUAL){ gWorld->spawnIntervalNS = std::max(0.6f, gWorld->spawnIntervalNS-0.2f); gWorld->spawnIntervalEW = std::max(0.6f, gWorld->spawnIntervalEW-0.2f); }
-        if(key==GLFW_KEY_MINUS){ gWorld->spawnIntervalNS += 0.2f; gWorld->spawnIntervalEW += 0.2f; }
+        std::this_thread::sleep_for(std::chrono::duration<double>(clock.step * (1.0 - clock.alpha())));
     }
+    if(journal.isOpen() && !journal.close(tick, world)) fprintf(stderr, "Journal write failed\n");
 }
 
-int main(){
-    printf("=== Traffic Light Management System ===\n");
-    printf("Controls:\n");
-    printf("  M - Toggle Manual/Automatic mode\n");
-    printf("  A - Set to Automatic mode\n");
-    printf("  P - Pause/Unpause simulation\n");
-    printf("  ESC - Exit\n");
-    printf("\nEMERGENCY CONTROLS (works in any mode):\n");
-    printf("  Shift + Arrow Keys - Emergency override for single lane:\n");
-    printf("    Shift+UP    - North lane GREEN (emergency vehicle)\n");
-    printf("    Shift+DOWN  - South lane GREEN (emergency vehicle)\n");
-    printf("    Shift+RIGHT - East lane GREEN (emergency vehicle)\n");
-    printf("    Shift+LEFT  - West lane GREEN (emergency vehicle)\n");
-    printf("\nMANUAL MODE CONTROLS:\n");
-    printf("  Arrow Keys (cycle through states):\n");
-    printf("    UP/DOWN  - Control North/South lights\n");
-    printf("    LEFT/RIGHT - Control East/West lights\n");
-    printf("\n  Number Keys (North/South):\n");
-    printf("    1,2,3 - North: Red, Yellow, Green\n");
-    printf("    4,5,6 - South: Red, Yellow, Green\n");
-    printf("\n  Letter Keys (East/West):\n");
-    printf("    Q,W,E - East: Red, Yellow, Green\n");
-    printf("    Z,X,C - West: Red, Yellow, Green\n");
-    printf("\n  Safety Controls:\n");
-    printf("    R - EMERGENCY STOP (all lights RED)\n");
-    printf("    G - All lights GREEN (use with caution!)\n");
-    printf("\nTraffic Controls:\n");
-    printf("  +/- keys - Adjust car spawn rate\n");
-    printf("========================================\n\n");
+int main(int argc, char** argv){
+    bool showStats = false;
+    int benchFrames = 0;
+    size_t benchCars = 2000;
+    int contextApi = 0;
+    const char* telemetryName = nullptr;
+    const char* record = nullptr;
+    int plan = 0;
+    FixedStepClock clock;
+    for(int i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "--stats")) showStats = true;
+        else if(!strcmp(argv[i], "--step") && i+1 < argc) clock.step = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--max-catchup") && i+1 < argc) clock.maxSteps = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--bench") && i+1 < argc){
+            benchFrames = atoi(argv[++i]);
+            if(benchFrames <= 0){ fprintf(stderr, "--bench takes a frame count of at least 1\n"); return 1; }
+        }
+        else if(!strcmp(argv[i], "--bench-cars") && i+1 < argc) benchCars = size_t(atol(argv[++i]));
+        else if(!strcmp(argv[i], "--offscreen") && i+1 < argc){
+            const char* api = argv[++i];
+            contextApi = !strcmp(api, "egl") ? GLFW_EGL_CONTEXT_API : !strcmp(api, "osmesa") ? GLFW_OSMESA_CONTEXT_API : -1;
+            if(contextApi < 0){ fprintf(stderr, "--offscreen takes egl or osmesa\n"); return 1; }
+        }
+        else if(!strcmp(argv[i], "--telemetry") && i+1 < argc) telemetryName = argv[++i];
+        else if(!strcmp(argv[i], "--record") && i+1 < argc) record = argv[++i];
+        else if(!strcmp(argv[i], "--plan") && i+1 < argc){
+            if((plan = signalPlanIndex(argv[++i])) < 0){ fprintf(stderr, "--plan takes two-phase, four-phase or actuated\n"); return 1; }
+        }
+    }
+    if(clock.step <= 0.0) clock.step = 1.0 / 1000.0;
+    if(clock.maxSteps < 1) clock.maxSteps = 1;
+    if(!benchFrames){
+        printf("=== Traffic Light Management System ===\n");
+        printf("Controls:\n");
+        printf("  M - Toggle Manual/Automatic mode\n");
+        printf("  A - Set to Automatic mode\n");
+        printf("  P - Pause/Unpause simulation\n");
+        printf("  ESC - Exit\n");
+        printf("\nEMERGENCY CONTROLS (works in any mode):\n");
+        printf("  Shift + Arrow Keys - Emergency override for single lane:\n");
+        printf("    Shift+UP    - North lane GREEN (emergency vehicle)\n");
+        printf("    Shift+DOWN  - South lane GREEN (emergency vehicle)\n");
+        printf("    Shift+RIGHT - East lane GREEN (emergency vehicle)\n");
+        printf("    Shift+LEFT  - West lane GREEN (emergency vehicle)\n");
+        printf("\nMANUAL MODE CONTROLS:\n");
+        printf("  Arrow Keys (cycle through states):\n");
+        printf("    UP/DOWN  - Control North/South lights\n");
+        printf("    LEFT/RIGHT - Control East/West lights\n");
+        printf("\n  Number Keys (North/South):\n");
+        printf("    1,2,3 - North: Red, Yellow, Green\n");
+        printf("    4,5,6 - South: Red, Yellow, Green\n");
+        printf("\n  Letter Keys (East/West):\n");
+        printf("    Q,W,E - East: Red, Yellow, Green\n");
+        printf("    Z,X,C - West: Red, Yellow, Green\n");
+        printf("\n  Safety Controls:\n");
+        printf("    R - EMERGENCY STOP (all lights RED)\n");
+        printf("    G - All lights GREEN (use with caution!)\n");
+        printf("\nTraffic Controls:\n");
+        printf("  +/- keys - Adjust car spawn rate\n");
+        printf("\nOptions:\n");
+        printf("  --stats            Print frame, tick and command latency stats once a second\n");
+        printf("  --step S           Fixed simulation step in seconds (default 1/1000)\n");
+        printf("  --max-catchup N    Max simulation steps per frame after a hitch (default 8)\n");
+        printf("  --bench N          Render a scripted scene for N frames in a hidden window and exit\n");
+        printf("  --bench-cars N     Cars in the benchmark scene (default 2000)\n");
+        printf("  --offscreen API    Create the context with egl or osmesa on GLFW's null platform\n");
+        printf("  --telemetry NAME   Publish every tick to the shared-memory ring NAME (e.g. /traffic)\n");
+        printf("  --record FILE      Journal commands and spawns to FILE (traffic_headless --replay FILE)\n");
+        printf("  --plan NAME        Signal plan: two-phase (default), four-phase or actuated\n");
+        printf("========================================\n\n");
+    }
+    // Without a display (CI), the null platform plus an EGL or OSMesa context renders
+    // on the CPU, e.g. through Mesa's llvmpipe.
+    if(contextApi) glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
     if(!glfwInit()){ fprintf(stderr, "Failed to init GLFW\n"); return -1; }
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR,3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR,3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if(benchFrames) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    if(contextApi) glfwWindowHint(GLFW_CONTEXT_CREATION_API, contextApi);
     GLFWwindow* win = glfwCreateWindow(1280, 720, "Traffic Light Management (GLFW+GLAD)", nullptr, nullptr);
     if(!win){ fprintf(stderr, "Failed to create window\n"); glfwTerminate(); return -1; }
     glfwMakeContextCurrent(win);
-    glfwSwapInterval(1);
+    glfwSwapInterval(benchFrames ? 0 : 1);
     if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)){
         fprintf(stderr, "Failed to init GLAD\n"); return -1; }
-    World world; gWorld = &world; world.initGL();
+    if(benchFrames){
+        int rc = runRenderBench(benchFrames, benchCars);
+        glfwDestroyWindow(win);
+        glfwTerminate();
+        return rc;
+    }
+    // The simulation runs on its own thread; this one only polls input and draws the
+    // newest snapshot, so a slow frame never holds up the traffic logic.
+    World world;
+    world.light.setPlan(*kSignalPlans[plan].plan);
+    world.keepPrevious = true;
+    TripleBuffer<WorldSnapshot> snapshots;
+    std::atomic<bool> running{true};
+    TelemetryWriter telemetry;
+    if(telemetryName && !telemetry.open(telemetryName)) return 1;
+    JournalWriter journal;
+    if(record && !journal.open(record, float(clock.step), world.spawnIntervalNS, world.spawnIntervalEW, uint8_t(plan))) return 1;
+    std::thread sim(simulate, std::ref(world), std::ref(clock), std::ref(snapshots), std::ref(running), showStats,
+                    std::ref(telemetry), std::ref(journal));
+    Renderer renderer; renderer.initGL();
     glfwSetKeyCallback(win, keyCallback);
-    double last = glfwGetTime();
+    double statsStart = glfwGetTime(), submitSum = 0; int statsFrames = 0;
+    uint64_t statsTick = 0;
     while(!glfwWindowShouldClose(win)){
         double now = glfwGetTime();
-        float dt = float(now - last); last = now;
         glfwPollEvents();
-        world.update(dt);
+        snapshots.refresh();
+        const WorldSnapshot& snap = snapshots.front();
+        // Cars are drawn one tick behind, moving from the previous to the latest state.
+        float alpha = float(std::min(1.0, std::max(0.0, (secondsNow() - snap.time) / clock.step)));
         int w,h; glfwGetFramebufferSize(win,&w,&h);
         glViewport(0,0,w,h);
         glClearColor(0.08f,0.09f,0.11f,1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
-        world.drawWorld();
+        renderer.drawWorld(snap, alpha);
         glfwSwapBuffers(win);
+        if(showStats){
+            submitSum += renderer.stats.submitMs; statsFrames++;
+            if(now - statsStart >= 1.0){
+                printf("frame: %.1f fps, %.3f ms submit, %d draw calls, %d instances; sim: %.0f ticks/s\n",
+                       statsFrames / (now - statsStart), submitSum / statsFrames,
+                       renderer.stats.drawCalls, renderer.stats.instances,
+                       (snap.tick - statsTick) / (now - statsStart));
+                statsStart = now; submitSum = 0; statsFrames = 0; statsTick = snap.tick;
+            }
+        }
     }
+    running = false;
+    sim.join();
     glfwDestroyWindow(win);
     glfwTerminate();
     return 0;
@@ -0,0 +1,221 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "traffic_core.h"
+
+// Per-tick telemetry in a POSIX shared-memory ring. The segment is a TelemetryHeader
+// followed by `slots` frames of frameBytes each; frame n of the run lives in slot
+// n % slots. Every slot is a seqlock: its seq is 2n+1 while frame n is being written
+// and 2n+2 once it is complete, so a reader mapping the segment read-only can check,
+// without any syscall or copy, that the frame it read in place is whole and still the
+// one it asked for. The writer never looks at readers: a slow one just finds its frame
+// overwritten and moves on to a newer one.
+//
+// The layout is fixed-width and versioned; readers check magic and version and use
+// frameBytes and maxCars from the header rather than their own sizeof.
+
+const uint32_t kTelemetryMagic = 0x314d4c54; // "TLM1"
+const uint32_t kTelemetryVersion = 1;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "telemetry needs lock-free 64-bit atomics");
+
+struct TelemetryHeader {
+    std::atomic<uint32_t> magic; // kTelemetryMagic once the segment is initialized
+    uint32_t version;
+    uint32_t headerBytes, frameBytes;
+    uint32_t slots, maxCars;
+    // Frames published so far; the newest is frame published - 1.
+    alignas(64) std::atomic<uint64_t> published;
+};
+
+struct TelemetryCar {
+    float x, y;
+    uint8_t axis;    // 'N', 'S', 'E' or 'W'
+    uint8_t lane;
+    uint8_t stopped; // held this tick, by a signal or the car ahead
+    uint8_t pad;
+};
+
+struct TelemetryFrame {
+    std::atomic<uint64_t> seq;
+    uint64_t tick;
+    double time;                // simulated seconds
+    uint8_t lights[4];          // N, S, E, W as LightState
+    uint8_t manual, emergency, paused, pad;
+    float nextChange;           // seconds until the controller next changes, -1 if none
+    float spawnTimerNS, spawnTimerEW;
+    float spawnIntervalNS, spawnIntervalEW;
+    uint32_t queued[4];         // stopped cars per approach, N, S, E, W
+    uint32_t live;              // live cars; only the first `cars` are listed
+    uint32_t cars;
+    TelemetryCar car[1];        // maxCars entries
+};
+
+inline size_t telemetryFrameBytes(uint32_t maxCars){
+    size_t n = offsetof(TelemetryFrame, car) + sizeof(TelemetryCar) * (maxCars ? maxCars : 1);
+    return (n + 63) & ~size_t(63);
+}
+
+class TelemetryWriter {
+public:
+    ~TelemetryWriter(){ close(); }
+
+    // name is a shm_open name such as "/traffic". Replaces any segment of that name.
+    bool open(const char* name, uint32_t slots = 64, uint32_t maxCars = 4096){
+        close();
+        if(slots < 2){ fprintf(stderr, "telemetry: need at least 2 slots\n"); return false; }
+        frameBytes = telemetryFrameBytes(maxCars);
+        bytes = sizeof(TelemetryHeader) + frameBytes * slots;
+        shm_unlink(name);
+        int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+        if(fd < 0){ perror("telemetry: shm_open"); return false; }
+        void* p = ftruncate(fd, off_t(bytes)) == 0 ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if(p == MAP_FAILED){ perror("telemetry: mmap"); shm_unlink(name); return false; }
+        base = static_cast<uint8_t*>(p);
+        this->name = name;
+        header = new (base) TelemetryHeader();
+        header->version = kTelemetryVersion;
+        header->headerBytes = sizeof(TelemetryHeader);
+        header->frameBytes = uint32_t(frameBytes);
+        header->slots = slots;
+        header->maxCars = maxCars;
+        header->published.store(0, std::memory_order_relaxed);
+        for(uint32_t s = 0; s < slots; s++) new (&frame(s).seq) std::atomic<uint64_t>(0);
+        header->magic.store(kTelemetryMagic, std::memory_order_release);
+        return true;
+    }
+
+    void close(){
+        if(!base) return;
+        munmap(base, bytes);
+        shm_unlink(name.c_str());
+        base = nullptr;
+        header = nullptr;
+    }
+
+    bool isOpen() const { return base != nullptr; }
+
+    // Writes the state of w after the given tick as the next frame. Plain stores into
+    // the mapping; never blocks and makes no syscall.
+    void publish(const World& w, uint64_t tick, double time){
+        if(!base) return;
+        const uint64_t n = header->published.load(std::memory_order_relaxed);
+        TelemetryFrame& f = frame(uint32_t(n % header->slots));
+        f.seq.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        f.tick = tick;
+        f.time = time;
+        f.lights[0] = uint8_t(w.light.north.state); f.lights[1] = uint8_t(w.light.south.state);
+        f.lights[2] = uint8_t(w.light.east.state); f.lights[3] = uint8_t(w.light.west.state);
+        f.manual = w.light.manual; f.emergency = w.light.emergencyMode; f.paused = w.paused; f.pad = 0;
+        f.nextChange = w.light.nextChangeIn();
+        f.spawnTimerNS = w.spawnTimerNS; f.spawnTimerEW = w.spawnTimerEW;
+        f.spawnIntervalNS = w.spawnIntervalNS; f.spawnIntervalEW = w.spawnIntervalEW;
+        uint32_t queued[4] = {};
+        uint32_t listed = 0;
+        const VehicleStore& c = w.cars;
+        for(size_t i = 0; i < c.size(); i++){
+            if(!c.active[i]) continue;
+            const char axis = char(c.axis[i]);
+            const int a = axis=='N' ? 0 : axis=='S' ? 1 : axis=='E' ? 2 : 3;
+            queued[a] += c.stop[i];
+            if(listed == header->maxCars) continue;
+            f.car[listed++] = TelemetryCar{c.x[i], c.y[i], c.axis[i], c.lane[i], c.stop[i], 0};
+        }
+        for(int a = 0; a < 4; a++) f.queued[a] = queued[a];
+        f.live = uint32_t(c.live());
+        f.cars = listed;
+        f.seq.store(2 * n + 2, std::memory_order_release);
+        header->published.store(n + 1, std::memory_order_release);
+    }
+
+private:
+    uint8_t* base = nullptr;
+    TelemetryHeader* header = nullptr;
+    size_t bytes = 0, frameBytes = 0;
+    std::string name;
+
+    TelemetryFrame& frame(uint32_t slot){
+        return *reinterpret_cast<TelemetryFrame*>(base + sizeof(TelemetryHeader) + frameBytes * slot);
+    }
+};
+
+// Read side, for dashboards: maps the segment read-only and reads frames in place.
+class TelemetryReader {
+public:
+    ~TelemetryReader(){ close(); }
+
+    // False if the segment does not exist yet or has an unknown layout.
+    bool open(const char* name){
+        close();
+        int fd = shm_open(name, O_RDONLY, 0);
+        if(fd < 0) return false;
+        struct stat st;
+        void* p = fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(TelemetryHeader)
+                ? mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if(p == MAP_FAILED) return false;
+        base = static_cast<const uint8_t*>(p);
+        bytes = size_t(st.st_size);
+        header = reinterpret_cast<const TelemetryHeader*>(base);
+        if(header->magic.load(std::memory_order_acquire) != kTelemetryMagic || header->version != kTelemetryVersion
+           || sizeof(TelemetryHeader) + size_t(header->frameBytes) * header->slots > bytes){
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close(){
+        if(base) munmap(const_cast<uint8_t*>(base), bytes);
+        base = nullptr;
+        header = nullptr;
+    }
+
+    // Frames published so far; 0 before the first tick.
+    uint64_t published() const { return header ? header->published.load(std::memory_order_acquire) : 0; }
+    uint32_t slots() const { return header ? header->slots : 0; }
+    uint32_t maxCars() const { return header ? header->maxCars : 0; }
+
+    // Calls f(frame) on frame n in place and returns true if the frame was complete
+    // and unchanged throughout, false if it was being written, overwritten by a newer
+    // frame or not published yet. f must only read, and must not trust what it read
+    // (pointers, counts used as indices) beyond bounds checks until this returns true.
+    template<class F>
+    bool read(uint64_t n, F&& f) const {
+        if(!header || n >= published() || published() - n > header->slots) return false;
+        const TelemetryFrame& fr = *reinterpret_cast<const TelemetryFrame*>(
+            base + header->headerBytes + size_t(header->frameBytes) * (n % header->slots));
+        const uint64_t want = 2 * n + 2;
+        if(fr.seq.load(std::memory_order_acquire) != want) return false;
+        f(fr);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return fr.seq.load(std::memory_order_relaxed) == want;
+    }
+
+    // The newest frame, retried until one reads whole.
+    template<class F>
+    bool readLatest(F&& f) const {
+        for(int tries = 0; tries < 64; tries++){
+            uint64_t n = published();
+            if(!n) return false;
+            if(read(n - 1, f)) return true;
+        }
+        return false;
+    }
+
+private:
+    const uint8_t* base = nullptr;
+    size_t bytes = 0;
+    const TelemetryHeader* header = nullptr;
+};
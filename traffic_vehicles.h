@@ -0,0 +1,158 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+class Car {
+public:
+    float x=0, y=0;
+    float px=0, py=0;
+    float vx=0, vy=0;
+    float speed=6.0f;
+    float w=1.6f, h=0.9f;
+    bool active=true;
+    int lane=0;
+    char axis='N';
+
+    void update(float dt){ x += vx*speed*dt; y += vy*speed*dt; }
+    void markPrevious(){ px = x; py = y; }
+};
+
+// Refers to a vehicle slot; stale once the slot is retired (and possibly reused).
+struct VehicleHandle {
+    uint32_t slot = 0xffffffffu;
+    uint32_t generation = 0;
+};
+
+// Pooled structure-of-arrays vehicle storage. Car stays the record type used to spawn
+// and hand vehicles around; the per-tick passes read and write these columns directly.
+// stop is the per-tick hold mask: 1 means the vehicle does not move this tick.
+// A vehicle keeps its slot for life. Retired slots go on a free list and are reused
+// last-in first-out, so after warm-up spawning and retiring touch no heap. Columns start
+// empty unless a capacity is given, since a grid holds one store per node, and grow
+// with the peak fleet. Free slots
+// have active = 0 and stop = 1, so passes over all slots leave them in place, and each
+// slot's generation is bumped on retirement so handles can detect reuse.
+class VehicleStore {
+public:
+    std::vector<float> x, y, px, py, vx, vy, speed, w, h;
+    std::vector<uint8_t> lane, axis, active, stop;
+    std::vector<uint32_t> generation;
+
+    explicit VehicleStore(size_t capacity = 0){ reserve(capacity); }
+
+    // Slots handed out so far, live or free; per-slot passes run over [0, size()).
+    size_t size() const { return x.size(); }
+    size_t live() const { return x.size() - freeSlots.size(); }
+    bool empty() const { return live() == 0; }
+
+    void reserve(size_t n){
+        for(auto* c : {&x, &y, &px, &py, &vx, &vy, &speed, &w, &h}) c->reserve(n);
+        for(auto* c : {&lane, &axis, &active, &stop}) c->reserve(n);
+        generation.reserve(n);
+        freeSlots.reserve(n);
+    }
+
+    uint32_t acquire(const Car& c){
+        uint32_t i;
+        if(!freeSlots.empty()){
+            i = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            i = uint32_t(x.size());
+            for(auto* col : {&x, &y, &px, &py, &vx, &vy, &speed, &w, &h}) col->push_back(0.f);
+            for(auto* col : {&lane, &axis, &active, &stop}) col->push_back(0);
+            generation.push_back(0);
+        }
+        x[i] = c.x; y[i] = c.y; px[i] = c.px; py[i] = c.py;
+        vx[i] = c.vx; vy[i] = c.vy; speed[i] = c.speed;
+        w[i] = c.w; h[i] = c.h;
+        lane[i] = uint8_t(c.lane); axis[i] = uint8_t(c.axis);
+        active[i] = c.active ? 1 : 0;
+        stop[i] = 0;
+        return i;
+    }
+
+    void release(uint32_t i){
+        active[i] = 0;
+        stop[i] = 1;
+        generation[i]++;
+        freeSlots.push_back(i);
+    }
+
+    VehicleHandle handle(uint32_t i) const { return VehicleHandle{i, generation[i]}; }
+    bool valid(VehicleHandle hd) const {
+        return hd.slot < size() && generation[hd.slot] == hd.generation && active[hd.slot];
+    }
+
+    Car get(size_t i) const {
+        Car c;
+        c.x = x[i]; c.y = y[i]; c.px = px[i]; c.py = py[i];
+        c.vx = vx[i]; c.vy = vy[i]; c.speed = speed[i];
+        c.w = w[i]; c.h = h[i];
+        c.active = active[i] != 0; c.lane = lane[i]; c.axis = char(axis[i]);
+        return c;
+    }
+
+    void markPrevious(){
+        px.assign(x.begin(), x.end());
+        py.assign(y.begin(), y.end());
+    }
+
+private:
+    std::vector<uint32_t> freeSlots;
+};
+
+// Advances every vehicle whose stop flag is clear: p += v*speed*dt. The SIMD paths
+// do the same multiply-multiply-add sequence as the scalar one, so SSE2, AVX2 and
+// scalar builds give bit-identical positions as long as the compiler does not fuse
+// the scalar multiply and add into an FMA. GCC in GNU mode does that on FMA targets
+// (-march=native), so build with -ffp-contract=off, as the README commands do.
+static inline void integrateVehicles(VehicleStore& s, float dt){
+    float* x = s.x.data(); float* y = s.y.data();
+    const float* vx = s.vx.data(); const float* vy = s.vy.data();
+    const float* sp = s.speed.data();
+    const uint8_t* stop = s.stop.data();
+    size_t n = s.size(), i = 0;
+#if defined(__AVX2__)
+    const __m256 vdt = _mm256_set1_ps(dt);
+    const __m256i zero = _mm256_setzero_si256();
+    for(; i + 8 <= n; i += 8){
+        __m128i m8 = _mm_loadl_epi64((const __m128i*)(stop + i));
+        __m256 hold = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_cvtepu8_epi32(m8), zero));
+        __m256 s8 = _mm256_loadu_ps(sp + i);
+        __m256 dx = _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(vx + i), s8), vdt);
+        __m256 dy = _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(vy + i), s8), vdt);
+        __m256 x8 = _mm256_loadu_ps(x + i), y8 = _mm256_loadu_ps(y + i);
+        _mm256_storeu_ps(x + i, _mm256_blendv_ps(_mm256_add_ps(x8, dx), x8, hold));
+        _mm256_storeu_ps(y + i, _mm256_blendv_ps(_mm256_add_ps(y8, dy), y8, hold));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 vdt = _mm_set1_ps(dt);
+    const __m128i zero = _mm_setzero_si128();
+    for(; i + 4 <= n; i += 4){
+        int32_t m4; memcpy(&m4, stop + i, 4);
+        __m128i m = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(m4), zero), zero);
+        __m128 hold = _mm_castsi128_ps(_mm_cmpgt_epi32(m, zero));
+        __m128 s4 = _mm_loadu_ps(sp + i);
+        __m128 dx = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(vx + i), s4), vdt);
+        __m128 dy = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(vy + i), s4), vdt);
+        __m128 x4 = _mm_loadu_ps(x + i), y4 = _mm_loadu_ps(y + i);
+        _mm_storeu_ps(x + i, _mm_or_ps(_mm_and_ps(hold, x4), _mm_andnot_ps(hold, _mm_add_ps(x4, dx))));
+        _mm_storeu_ps(y + i, _mm_or_ps(_mm_and_ps(hold, y4), _mm_andnot_ps(hold, _mm_add_ps(y4, dy))));
+    }
+#endif
+    for(; i < n; i++){
+        if(stop[i]) continue;
+        float dx = vx[i]*sp[i]; dx = dx*dt;
+        float dy = vy[i]*sp[i]; dy = dy*dt;
+        x[i] = x[i] + dx;
+        y[i] = y[i] + dy;
+    }
+}